@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bot.h"
+
+#define DEAD_VALUE -1000000
+
+// One candidate in the beam: a simulated state and the action it started with
+typedef struct {
+    GameState state;
+    int first_keys;
+    int value;
+} BotNode;
+
+// Two beam generations, each parent expands into two children
+static BotNode beams[2][BOT_BEAM_WIDTH * 2];
+
+// Higher is better. Dead states rank by how long they survived, live ones by
+// score and then by how close the bird is to its aim point in the next gap. The
+// target is the first pipe the front of the bird has not yet cleared, so it
+// already lines up for the next gap while its tail is still in the current one.
+static int evaluate(const GameState *state, int depth, int aim) {
+    const PipeStream *pipes = &state->pipes;
+    int target = state->screen_y / 2;
+
+    if (state->game_over) {
+        return DEAD_VALUE + depth;
+    }
+    for (unsigned int i = 0; i < pipes->visible; i++) {
+        const Pipe *pipe = pipe_stream_get((PipeStream *)pipes, i);
+        if (pipe_x(pipes, pipe) + PIPE_WIDTH > state->bird.x + BIRD_MASK_WIDTH) {
+            target = pipe->top_height + pipe->gap / 2 + aim;
+            break;
+        }
+    }
+    return state->score * 10000 - abs(state->bird.y - target);
+}
+
+// Move the best `keep` of count nodes to the front
+static void select_best(BotNode *nodes, int count, int keep) {
+    for (int i = 0; i < keep && i < count; i++) {
+        int best = i;
+        for (int j = i + 1; j < count; j++) {
+            if (nodes[j].value > nodes[best].value) {
+                best = j;
+            }
+        }
+        if (best != i) {
+            BotNode temp = nodes[i];
+            nodes[i] = nodes[best];
+            nodes[best] = temp;
+        }
+    }
+}
+
+// Keys to press this tick. While the game is over the bot waits, then restarts.
+int bot_decide(Bot *bot, const GameState *game) {
+    struct timespec start, end;
+    int current = 0, count = 1, nodes = 0;
+    int budget = bot->budget ? bot->budget : BOT_NODE_BUDGET;
+
+    if (game->game_over) {
+        if (++bot->game_over_ticks < BOT_RESTART_TICKS) {
+            return 0;
+        }
+        bot->game_over_ticks = 0;
+        return KEY_RESTART;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    beams[current][0].state = *game;
+    beams[current][0].first_keys = 0;
+    beams[current][0].value = 0;
+
+    for (int depth = 0; depth < BOT_HORIZON && nodes < budget; depth++) {
+        BotNode *parents = beams[current];
+        BotNode *children = beams[!current];
+        int next = 0;
+
+        for (int i = 0; i < count && nodes < budget; i++) {
+            // Dead states have nothing left to explore, carry them over once
+            if (parents[i].state.game_over) {
+                children[next++] = parents[i];
+                continue;
+            }
+            for (int keys = 0; keys <= KEY_FLAP && nodes < budget; keys += KEY_FLAP) {
+                BotNode *child = &children[next++];
+                child->state = parents[i].state;
+                game_step(&child->state, keys);
+                child->first_keys = (depth == 0) ? keys : parents[i].first_keys;
+                child->value = evaluate(&child->state, depth, bot->aim);
+                nodes++;
+            }
+        }
+        select_best(children, next, BOT_BEAM_WIDTH);
+        count = (next < BOT_BEAM_WIDTH) ? next : BOT_BEAM_WIDTH;
+        current = !current;
+    }
+
+    if (nodes >= budget) {
+        bot->budget_hits++;
+    }
+    bot->decisions++;
+    bot->nodes += nodes;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bot->busy_ns += (long long)(end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+
+    // The beam is sorted, its first node is the best line found
+    return beams[current][0].first_keys;
+}
+
+void bot_print_stats(const char *name, const Bot *bot) {
+    if (bot->decisions == 0) {
+        return;
+    }
+    printf("%s: %lu decisions, %.0f decisions/s, %.0f nodes/decision, %.1f us/decision, "
+           "%lu over budget\n", name, bot->decisions,
+           bot->busy_ns > 0 ? bot->decisions * 1e9 / bot->busy_ns : 0.0,
+           (double)bot->nodes / bot->decisions, bot->busy_ns / 1e3 / bot->decisions,
+           bot->budget_hits);
+}
@@ -0,0 +1,28 @@
+#ifndef BOT_H_
+#define BOT_H_
+
+#include "game.h"
+
+#define BOT_HORIZON 48          // Ticks simulated ahead of the current one
+#define BOT_BEAM_WIDTH 12       // States kept at each depth of the search
+#define BOT_NODE_BUDGET 1200    // game_step() calls allowed per decision
+#define BOT_TICK_BUDGET 4800    // game_step() calls per tick shared by every bot flying
+#define BOT_RESTART_TICKS 120   // Ticks the game over screen stays up before restarting
+
+// Autopilot that picks each tick's keys by beam search over flap / no flap,
+// stepping copies of the game state ahead. Only used from the simulation thread.
+typedef struct {
+    int aim;                    // Pixels below the middle of each gap the bird aims for
+    int budget;                 // game_step() calls per decision, 0 for BOT_NODE_BUDGET
+    int game_over_ticks;        // Ticks since the current game ended
+    unsigned long decisions;
+    unsigned long long nodes;   // States simulated over all decisions
+    unsigned long budget_hits;  // Decisions cut short by the node budget
+    long long busy_ns;
+} Bot;
+
+// Function prototypes
+int bot_decide(Bot *bot, const GameState *game);
+void bot_print_stats(const char *name, const Bot *bot);
+
+#endif /* BOT_H_ */
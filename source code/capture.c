@@ -0,0 +1,309 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture.h"
+#include "physical.h"
+
+static long long capture_ns(const struct timespec *from, const struct timespec *to) {
+    return (long long)(to->tv_sec - from->tv_sec) * 1000000000LL + (to->tv_nsec - from->tv_nsec);
+}
+
+// Pixels from i on that equal frame[i], up to CAPTURE_MAX_RUN
+static int fill_length(const uint16_t *frame, int i, int pixels) {
+    int j = i + 1;
+
+    while (j < pixels && j - i < CAPTURE_MAX_RUN && frame[j] == frame[i]) {
+        j++;
+    }
+    return j - i;
+}
+
+// Delta-encode frame against previous into out, which must hold 2 * pixels
+// words. Unchanged pixels become skips, runs of one color fills and anything
+// else literal copies. Returns the number of words written.
+size_t capture_encode(const uint16_t *frame, const uint16_t *previous, int pixels, uint16_t *out) {
+    size_t words = 0;
+    int i = 0;
+
+    while (i < pixels) {
+        int start = i;
+
+        if (frame[i] == previous[i]) {
+            while (i < pixels && i - start < CAPTURE_MAX_RUN && frame[i] == previous[i]) {
+                i++;
+            }
+            out[words++] = CAPTURE_SKIP | (i - start);
+            continue;
+        }
+
+        int fill = fill_length(frame, i, pixels);
+        if (fill >= 3) {
+            out[words++] = CAPTURE_FILL | fill;
+            out[words++] = frame[i];
+            i += fill;
+            continue;
+        }
+
+        // Literal pixels until an unchanged pixel or a run worth a fill
+        size_t token = words++;
+        while (i < pixels && i - start < CAPTURE_MAX_RUN && frame[i] != previous[i] &&
+               (i + 2 >= pixels || frame[i] != frame[i + 1] || frame[i] != frame[i + 2])) {
+            out[words++] = frame[i++];
+        }
+        if (i == start) {
+            out[words++] = frame[i++];  // Starts a fill too short to pay off
+        }
+        out[token] = CAPTURE_COPY | (i - start);
+    }
+    return words;
+}
+
+// Encode and write frames in the order they were grabbed
+static void *capture_thread(void *arg) {
+    Capture *capture = arg;
+    int pixels = capture->width * capture->height;
+    struct timespec start, end;
+
+    for (;;) {
+        pthread_mutex_lock(&capture->lock);
+        while (capture->head == capture->tail && !capture->closed) {
+            pthread_cond_wait(&capture->ready, &capture->lock);
+        }
+        if (capture->head == capture->tail) {
+            pthread_mutex_unlock(&capture->lock);
+            break;
+        }
+        if (capture->failed) {
+            capture->tail = capture->head;  // Nothing more is written after a failure
+            pthread_mutex_unlock(&capture->lock);
+            continue;
+        }
+        unsigned int slot = capture->tail % CAPTURE_SLOTS;
+        pthread_mutex_unlock(&capture->lock);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint16_t *frame = capture->slots[slot];
+        uint32_t size = capture_encode(frame, capture->previous, pixels, capture->encoded) * sizeof(uint16_t);
+        if (fwrite(&size, sizeof(size), 1, capture->file) != 1 ||
+            fwrite(capture->encoded, size, 1, capture->file) != 1) {
+            // Stop grabbing, the queued frames are dropped
+            perror("Error writing capture file");
+            pthread_mutex_lock(&capture->lock);
+            capture->failed = 1;
+            pthread_mutex_unlock(&capture->lock);
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        capture->encode_ns += capture_ns(&start, &end);
+        capture->bytes += sizeof(size) + size;
+        capture->frames++;
+
+        // The frame becomes the reference, the old reference the free slot
+        pthread_mutex_lock(&capture->lock);
+        capture->slots[slot] = capture->previous;
+        capture->previous = frame;
+        capture->tail++;
+        pthread_mutex_unlock(&capture->lock);
+    }
+    return NULL;
+}
+
+// Copy each presented frame into a free slot, row by row out of the front
+// buffer. The render thread draws into that buffer again only after its next
+// swap, so a copy that ends before the swap count moves is a whole frame.
+static void *grab_thread(void *arg) {
+    Capture *capture = arg;
+    unsigned long grabbed = 0;
+    struct timespec start, end;
+
+    for (;;) {
+        pthread_mutex_lock(&capture->lock);
+        while (capture->presented == grabbed && !capture->stopping) {
+            pthread_cond_wait(&capture->swapped, &capture->lock);
+        }
+        if (capture->stopping) {
+            pthread_mutex_unlock(&capture->lock);
+            break;
+        }
+        unsigned long presented = capture->presented;
+        const char *buffer = (capture->shown == PIXEL_BUFFER_1) ? capture->buffers[0] : capture->buffers[1];
+        int full = capture->head - capture->tail == CAPTURE_SLOTS;
+        int failed = capture->failed;
+        pthread_mutex_unlock(&capture->lock);
+
+        if (failed) {
+            grabbed = presented;
+            continue;
+        }
+        capture->dropped += presented - grabbed - 1;  // Swapped again before this thread woke
+        grabbed = presented;
+        if (full) {
+            capture->dropped++;
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint16_t *slot = capture->slots[capture->head % CAPTURE_SLOTS];
+        for (int y = 0; y < capture->height; y++) {
+            memcpy(slot + y * capture->width, buffer + y * PIXEL_ROW_BYTES, capture->width * sizeof(uint16_t));
+        }
+
+        // The reads of the copy have to complete before the swap count is checked
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        pthread_mutex_lock(&capture->lock);
+        int torn = capture->presented != presented;
+        if (!torn) {
+            capture->head++;
+            pthread_cond_signal(&capture->ready);
+        }
+        pthread_mutex_unlock(&capture->lock);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        capture->grab_ns += capture_ns(&start, &end);
+        capture->torn += torn;
+    }
+    return NULL;
+}
+
+int capture_open(Capture *capture, int fd, const char *path, int width, int height) {
+    size_t frame_size = (size_t)width * height * sizeof(uint16_t);
+    struct {
+        uint32_t magic;
+        uint16_t width, height;
+    } header = { CAPTURE_MAGIC, width, height };
+
+    memset(capture, 0, sizeof(*capture));
+    capture->width = width;
+    capture->height = height;
+    capture->buffers[0] = map_physical(fd, PIXEL_BUFFER_1, PIXEL_BUFFER_SPAN);
+    capture->buffers[1] = map_physical(fd, PIXEL_BUFFER_2, PIXEL_BUFFER_SPAN);
+    capture->front = map_physical(fd, PIXEL_CTRL_BASE, PIXEL_CTRL_SPAN);
+    if (capture->buffers[0] == NULL || capture->buffers[1] == NULL || capture->front == NULL) {
+        capture_close(capture);
+        return -1;
+    }
+
+    // The first frame is encoded against black
+    capture->previous = calloc(1, frame_size);
+    capture->encoded = malloc(2 * frame_size);
+    int allocated = capture->previous != NULL && capture->encoded != NULL;
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        capture->slots[i] = malloc(frame_size);
+        allocated = allocated && capture->slots[i] != NULL;
+    }
+    if (!allocated) {
+        perror("Error allocating capture buffers");
+        capture_close(capture);
+        return -1;
+    }
+
+    capture->file = fopen(path, "wb");
+    if (capture->file == NULL) {
+        perror(path);
+        capture_close(capture);
+        return -1;
+    }
+    if (fwrite(&header, sizeof(header), 1, capture->file) != 1) {
+        perror(path);
+        fclose(capture->file);
+        capture->file = NULL;
+        capture_close(capture);
+        return -1;
+    }
+
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->swapped, NULL);
+    pthread_cond_init(&capture->ready, NULL);
+    if (pthread_create(&capture->thread, NULL, capture_thread, capture) != 0) {
+        perror("Failed to create capture thread");
+        pthread_cond_destroy(&capture->ready);
+        pthread_cond_destroy(&capture->swapped);
+        pthread_mutex_destroy(&capture->lock);
+        fclose(capture->file);
+        capture->file = NULL;
+        capture_close(capture);
+        return -1;
+    }
+    if (pthread_create(&capture->grabber, NULL, grab_thread, capture) != 0) {
+        perror("Failed to create capture grab thread");
+        pthread_mutex_lock(&capture->lock);
+        capture->closed = 1;
+        pthread_cond_signal(&capture->ready);
+        pthread_mutex_unlock(&capture->lock);
+        pthread_join(capture->thread, NULL);
+        pthread_cond_destroy(&capture->ready);
+        pthread_cond_destroy(&capture->swapped);
+        pthread_mutex_destroy(&capture->lock);
+        fclose(capture->file);
+        capture->file = NULL;
+        capture_close(capture);
+        return -1;
+    }
+    return 0;
+}
+
+// Note a swap of the render thread. Reading the front buffer register is the
+// only access to the pixel buffers on that thread, the grab thread copies it.
+void capture_frame(Capture *capture) {
+    unsigned int shown = *capture->front;
+
+    pthread_mutex_lock(&capture->lock);
+    capture->shown = shown;
+    capture->presented++;
+    pthread_cond_signal(&capture->swapped);
+    pthread_mutex_unlock(&capture->lock);
+}
+
+// Finish writing the queued frames, release everything and print the statistics
+void capture_close(Capture *capture) {
+    if (capture->file != NULL) {
+        // Stop grabbing first so no frame is queued after the capture thread drains
+        pthread_mutex_lock(&capture->lock);
+        capture->stopping = 1;
+        pthread_cond_signal(&capture->swapped);
+        pthread_mutex_unlock(&capture->lock);
+        pthread_join(capture->grabber, NULL);
+
+        pthread_mutex_lock(&capture->lock);
+        capture->closed = 1;
+        pthread_cond_signal(&capture->ready);
+        pthread_mutex_unlock(&capture->lock);
+        pthread_join(capture->thread, NULL);
+        pthread_cond_destroy(&capture->ready);
+        pthread_cond_destroy(&capture->swapped);
+        pthread_mutex_destroy(&capture->lock);
+        if (fclose(capture->file) != 0 && !capture->failed) {
+            perror("Error writing capture file");
+            capture->failed = 1;
+        }
+        capture->file = NULL;
+        if (capture->failed) {
+            printf("Capture: write failed, the file holds only the first %lu frames\n", capture->frames);
+        }
+
+        unsigned long grabbed = capture->frames ? capture->frames : 1;
+        printf("Capture: %lu frames, %lu dropped, %lu torn, grab %.1f us/frame, encode %.1f us/frame\n",
+               capture->frames, capture->dropped, capture->torn, capture->grab_ns / 1e3 / grabbed,
+               capture->encode_ns / 1e3 / grabbed);
+        printf("Capture: %.0f bytes/frame, %.1f%% of raw\n", (double)capture->bytes / grabbed,
+               100.0 * capture->bytes / grabbed / (capture->width * capture->height * sizeof(uint16_t)));
+    }
+
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        free(capture->slots[i]);
+        capture->slots[i] = NULL;
+    }
+    free(capture->previous);
+    free(capture->encoded);
+    capture->previous = NULL;
+    capture->encoded = NULL;
+    for (int i = 0; i < 2; i++) {
+        if (capture->buffers[i] != NULL) {
+            unmap_physical(capture->buffers[i], PIXEL_BUFFER_SPAN);
+            capture->buffers[i] = NULL;
+        }
+    }
+    if (capture->front != NULL) {
+        unmap_physical((void *)capture->front, PIXEL_CTRL_SPAN);
+        capture->front = NULL;
+    }
+}
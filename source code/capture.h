@@ -0,0 +1,62 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define PIXEL_BUFFER_1 0xC8000000   // VGA pixel buffers, same as the driver
+#define PIXEL_BUFFER_2 0xC0000000
+#define PIXEL_BUFFER_SPAN 0x40000
+#define PIXEL_ROW_BYTES 0x400
+#define PIXEL_CTRL_BASE 0xFF203020  // Front buffer register of the pixel buffer controller
+#define PIXEL_CTRL_SPAN 16
+#define CAPTURE_SLOTS 4             // Frames grabbed but not yet encoded
+#define CAPTURE_MAGIC 0x56434246    // "FBCV" in a little-endian file
+
+// Each frame is a list of 16-bit tokens against the previous frame: the top
+// two bits pick the operation and the low 14 bits hold the pixel count
+#define CAPTURE_SKIP 0x0000         // Pixels unchanged from the previous frame
+#define CAPTURE_COPY 0x4000         // Count new pixels follow
+#define CAPTURE_FILL 0x8000         // Count pixels of the one color that follows
+#define CAPTURE_MAX_RUN 0x3FFF
+
+// Streams presented frames to a file. The render thread only counts its
+// swaps, a grab thread copies each presented front buffer into a free slot
+// before the next swap and a capture thread delta-encodes and writes it.
+typedef struct {
+    FILE *file;
+    int width, height;
+    void *buffers[2];               // Mapped PIXEL_BUFFER_1 and PIXEL_BUFFER_2
+    volatile unsigned int *front;   // Front buffer register
+    uint16_t *slots[CAPTURE_SLOTS];
+    uint16_t *previous;             // Last encoded frame
+    uint16_t *encoded;              // Tokens of the frame being written
+    unsigned int head, tail;        // Slots filled by the grab thread, drained by the capture thread
+    unsigned long presented;        // Swaps done by the render thread
+    unsigned int shown;             // Front buffer address after the last swap
+    int stopping;                   // The grab thread exits, set before closed
+    int closed;
+    int failed;                     // A write failed, nothing more is grabbed or written
+    pthread_t grabber;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t swapped;         // presented changed
+    pthread_cond_t ready;           // head changed
+
+    // Statistics, grab_ns, dropped and torn belong to the grab thread, the rest to the capture thread
+    unsigned long frames;
+    unsigned long dropped;          // Frames skipped because every slot was full or the grab thread woke late
+    unsigned long torn;             // Frames whose copy was overtaken by the next swap
+    long long grab_ns;
+    long long encode_ns;
+    unsigned long long bytes;
+} Capture;
+
+// Function prototypes
+int capture_open(Capture *capture, int fd, const char *path, int width, int height);
+void capture_frame(Capture *capture);
+void capture_close(Capture *capture);
+size_t capture_encode(const uint16_t *frame, const uint16_t *previous, int pixels, uint16_t *out);
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,186 @@
+// Host check and timing of the game's bird/pipe collision test (game.c):
+//
+//     gcc -O2 -o collision_bench collision_bench.c game.c pipes.c
+//
+// check_collision() is first compared against a per-pixel reference over every
+// bird height, pipe position, top height and gap near the bird, then timed
+// against the reference and the bounding box test it replaced on a scrolling
+// pipe stream. Exits non-zero if the row masks disagree with the reference.
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "game.h"
+
+#define SCREEN_X 320
+#define SCREEN_Y 240
+#define STATES 4096                    // Pipe stream positions timed
+#define BENCH_NANOSECONDS 200000000LL  // Time spent on each test
+
+static PipeStream states[STATES];
+static int bird_heights[STATES];
+static double bench_ns;                // ns per call of the last BENCH()
+
+static long long now_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// The bounding box test check_collision() replaced. It hits pipes in the
+// empty corners around the head and beak. Kept out of line so it is timed as
+// a call, like check_collision() in game.c.
+static __attribute__((noinline)) int aabb_collision(PipeStream *pipes, const Bird *bird) {
+    int bird_left = bird->x;
+    int bird_right = bird->x + BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2 + BIRD_BEAK_SIZE;
+    int bird_top = bird->y - BIRD_BODY_HEIGHT/2 - BIRD_HEAD_SIZE/2;
+    int bird_bottom = bird->y + BIRD_BODY_HEIGHT/2;
+
+    for (unsigned int i = 0; i < pipes->visible; i++) {
+        Pipe *pipe = pipe_stream_get(pipes, i);
+        int x = pipe_x(pipes, pipe);
+
+        if (bird_right < x || bird_left > x + PIPE_WIDTH) {
+            continue;
+        }
+        if (bird_top < pipe->top_height || bird_bottom > pipe->top_height + pipe->gap) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether screen pixel (x, y) is inside a pipe section
+static int pipe_pixel(PipeStream *pipes, int x, int y) {
+    for (unsigned int i = 0; i < pipes->visible; i++) {
+        Pipe *pipe = pipe_stream_get(pipes, i);
+        int left = pipe_x(pipes, pipe);
+
+        if (x >= left && x <= left + PIPE_WIDTH &&
+            (y < pipe->top_height || y > pipe->top_height + pipe->gap)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Test every pixel of a box relative to the bird, inclusive
+static int box_hits(PipeStream *pipes, const Bird *bird, int x1, int y1, int x2, int y2) {
+    for (int y = y1; y <= y2; y++) {
+        for (int x = x1; x <= x2; x++) {
+            if (pipe_pixel(pipes, bird->x + x, bird->y + y)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Pixel by pixel over the body, head and beak boxes draw_bird() uses
+static int reference_collision(PipeStream *pipes, const Bird *bird) {
+    return box_hits(pipes, bird, 0, -BIRD_BODY_HEIGHT/2, BIRD_BODY_WIDTH, BIRD_BODY_HEIGHT/2) ||
+           box_hits(pipes, bird, BIRD_BODY_WIDTH - BIRD_HEAD_SIZE/2, -BIRD_BODY_HEIGHT/2 - BIRD_HEAD_SIZE/2,
+                    BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2, -BIRD_BODY_HEIGHT/2 + BIRD_HEAD_SIZE/2) ||
+           box_hits(pipes, bird, BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2, -BIRD_BODY_HEIGHT/2 - BIRD_BEAK_SIZE/2,
+                    BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2 + BIRD_BEAK_SIZE, -BIRD_BODY_HEIGHT/2 + BIRD_BEAK_SIZE/2);
+}
+
+// One pipe swept across and around the bird with every top height and gap
+// the stream generates. check_collision() has to agree with the reference
+// everywhere, the bounding box only ever errs towards extra hits.
+static int check(void) {
+    PipeStream stream;
+    Bird bird = { SCREEN_X / 3, 0, 0, 0.0f };
+    long cases = 0, differ = 0, missed = 0, extra = 0;
+
+    pipe_stream_init(&stream, 1, SCREEN_X, SCREEN_Y);
+    stream.scroll = 0;
+    stream.visible = 1;
+    for (int gap = MIN_GAP_SIZE; gap <= GAP_SIZE; gap += 4) {
+        for (int top = MIN_PIPE_HEIGHT - 20; top <= MIN_PIPE_HEIGHT + MAX_PIPE_HEIGHT_DIFF; top += 3) {
+            for (int x = bird.x - PIPE_WIDTH - 2; x <= bird.x + BIRD_MASK_WIDTH + 1; x++) {
+                Pipe *pipe = pipe_stream_get(&stream, 0);
+
+                pipe->x = x;
+                pipe->top_height = top;
+                pipe->gap = gap;
+                for (bird.y = top - BIRD_MASK_HEIGHT; bird.y <= top + gap + BIRD_MASK_HEIGHT; bird.y++) {
+                    int expected = reference_collision(&stream, &bird);
+                    int aabb = aabb_collision(&stream, &bird);
+
+                    differ += check_collision(&stream, &bird) != expected;
+                    missed += expected && !aabb;
+                    extra += aabb && !expected;
+                    cases++;
+                }
+            }
+        }
+    }
+    printf("%ld cases: row masks differ from per-pixel in %ld, bounding box misses %ld and adds %ld hits: %s\n",
+           cases, differ, missed, extra, differ == 0 && missed == 0 ? "ok" : "FAILED");
+    return differ == 0 && missed == 0;
+}
+
+// ns per call of one collision test over the recorded stream states, from
+// the fastest pass over them so a preempted pass doesn't decide the ratio
+#define BENCH(label, test)                                                          \
+    do {                                                                            \
+        long long start = now_ns(), best = LLONG_MAX;                               \
+        long hits = 0;                                                              \
+        do {                                                                        \
+            long long pass = now_ns();                                              \
+            hits = 0;                                                               \
+            for (int i = 0; i < STATES; i++) {                                      \
+                Bird bird = { SCREEN_X / 3, bird_heights[i], 0, 0.0f };             \
+                hits += test(&states[i], &bird);                                    \
+            }                                                                       \
+            pass = now_ns() - pass;                                                 \
+            if (pass < best) {                                                      \
+                best = pass;                                                        \
+            }                                                                       \
+        } while (now_ns() - start < BENCH_NANOSECONDS);                             \
+        bench_ns = (double)best / STATES;                                           \
+        printf("  %-10s %9.1f ns/call, %d%% hits\n", label, bench_ns,              \
+               (int)(100 * hits / STATES));                                         \
+    } while (0)
+
+// Time the tests the way game_step() calls them, one scrolled pipe stream
+// state per tick with the bird moving through the gaps
+static void bench(void) {
+    PipeStream stream;
+    double aabb_ns;
+
+    pipe_stream_init(&stream, 1, SCREEN_X, SCREEN_Y);
+    for (int i = 0; i < STATES; i++) {
+        Pipe *next = pipe_stream_get(&stream, 0);
+
+        pipe_stream_advance(&stream, 1);
+        states[i] = stream;
+        bird_heights[i] = next->top_height + next->gap / 2 + (i * 7 % 41) - 20;
+    }
+
+    printf("Scrolling stream, %d states\n", STATES);
+    BENCH("aabb", aabb_collision);
+    aabb_ns = bench_ns;
+    BENCH("masks", check_collision);
+    printf("  row masks take %.0f%% of the bounding box time\n", 100.0 * bench_ns / aabb_ns);
+    BENCH("per-pixel", reference_collision);
+}
+
+int main(int argc, char *argv[]) {
+    int check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+    int ok;
+
+    if (argc > 1 && !check_only) {
+        fprintf(stderr, "Usage: %s [--check]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    build_bird_mask();
+    ok = check();
+    if (!check_only) {
+        bench();
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,208 @@
+#include <string.h>
+#include "game.h"
+
+// 1-bit row masks of the bird sprite, bit i = column bird.x + i, row 0 = head top.
+// bird_mask_above[r] is the OR of rows 0..r and bird_mask_below[r] the OR of rows
+// r..end, so a whole top or bottom pipe section is tested with a single AND.
+static uint32_t bird_mask[BIRD_MASK_HEIGHT];
+static uint32_t bird_mask_above[BIRD_MASK_HEIGHT];
+static uint32_t bird_mask_below[BIRD_MASK_HEIGHT];
+// Pipe column bits indexed by (pipe.x - bird.x + PIPE_WIDTH), precomputed with the masks
+static uint32_t pipe_column_mask[PIPE_WIDTH + BIRD_MASK_WIDTH];
+
+// Set the mask bits covered by a box given relative to (bird.x, bird.y), inclusive
+static void mask_box(int x1, int y1, int x2, int y2) {
+    for (int y = y1; y <= y2; y++) {
+        for (int x = x1; x <= x2; x++) {
+            bird_mask[y + BIRD_MASK_TOP] |= 1u << x;
+        }
+    }
+}
+
+// Rasterize the same body, head and beak boxes draw_bird() uses into row masks
+void build_bird_mask() {
+    memset(bird_mask, 0, sizeof(bird_mask));
+
+    mask_box(0, -BIRD_BODY_HEIGHT/2, BIRD_BODY_WIDTH, BIRD_BODY_HEIGHT/2);
+    mask_box(BIRD_BODY_WIDTH - BIRD_HEAD_SIZE/2,
+             -BIRD_BODY_HEIGHT/2 - BIRD_HEAD_SIZE/2,
+             BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2,
+             -BIRD_BODY_HEIGHT/2 + BIRD_HEAD_SIZE/2);
+    mask_box(BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2,
+             -BIRD_BODY_HEIGHT/2 - BIRD_BEAK_SIZE/2,
+             BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2 + BIRD_BEAK_SIZE,
+             -BIRD_BODY_HEIGHT/2 + BIRD_BEAK_SIZE/2);
+
+    bird_mask_above[0] = bird_mask[0];
+    for (int r = 1; r < BIRD_MASK_HEIGHT; r++) {
+        bird_mask_above[r] = bird_mask_above[r - 1] | bird_mask[r];
+    }
+    bird_mask_below[BIRD_MASK_HEIGHT - 1] = bird_mask[BIRD_MASK_HEIGHT - 1];
+    for (int r = BIRD_MASK_HEIGHT - 2; r >= 0; r--) {
+        bird_mask_below[r] = bird_mask_below[r + 1] | bird_mask[r];
+    }
+
+    for (int i = 0; i < PIPE_WIDTH + BIRD_MASK_WIDTH; i++) {
+        int lo = i - PIPE_WIDTH;
+        int hi = lo + PIPE_WIDTH;
+        if (lo < 0) lo = 0;
+        if (hi > BIRD_MASK_WIDTH - 1) hi = BIRD_MASK_WIDTH - 1;
+        pipe_column_mask[i] = (0xFFFFFFFFu << lo) & (0xFFFFFFFFu >> (BIRD_MASK_WIDTH - 1 - hi));
+    }
+}
+
+static void initialize_bird(GameState *game) {
+    // Position bird slightly to the right and in the middle of screen
+    game->bird.x = game->screen_x / 3;
+    game->bird.y = game->screen_y / 2;
+    game->bird.velocity = 0;  // Start with no vertical velocity
+    game->bird.fall_accumulator = 0.0f;
+}
+
+static void update_bird(GameState *game, int keys) {
+    Bird *bird = &game->bird;
+
+    if (keys & KEY_FLAP) {  // KEY0 pressed
+        // Move up immediately when button is pressed
+        bird->y -= FLAP_DISTANCE;
+        // Reset fall accumulator to prevent immediate fall after jump
+        bird->fall_accumulator = 0.0f;
+    }
+    // Update falling movement
+    bird->fall_accumulator += (float)GRAVITY_SPEED / GRAVITY_MULTIPLIER;
+    
+    // Move bird down when we've accumulated enough for 1 pixel
+    if (bird->fall_accumulator >= 1.0f) {
+        int pixels_to_fall = (int)bird->fall_accumulator;
+        bird->fall_accumulator -= pixels_to_fall;
+        
+        // Only update Y if not at bottom of screen
+        if (bird->y + BIRD_BODY_HEIGHT/2 + pixels_to_fall < game->screen_y - BOTTOM_MARGIN) {
+            bird->y += pixels_to_fall;
+        }
+    }
+    // Keep bird within screen bounds
+    if (bird->y - BIRD_BODY_HEIGHT/2 < 0) {
+        bird->y = BIRD_BODY_HEIGHT/2;
+    }
+}
+
+// Returns EVENT_SCORED if the bird passed a pipe this tick
+static int update_score(GameState *game) {
+    int events = 0;
+
+    for (unsigned int i = 0; i < game->pipes.visible; i++) {
+        Pipe *pipe = pipe_stream_get(&game->pipes, i);
+
+        // Check if bird has fully passed this pipe and hasn't been counted yet
+        if (!pipe->passed && 
+            game->bird.x > (pipe_x(&game->pipes, pipe) + PIPE_WIDTH)) {
+            game->score++;
+            pipe->passed = 1;
+            events |= EVENT_SCORED;
+        }
+    }
+    return events;
+}
+
+// Check if bird has collided with any pipe using the precomputed row masks
+int check_collision(PipeStream *pipes, const Bird *bird) {
+    int bird_left = bird->x;
+    int bird_right = bird->x + BIRD_MASK_WIDTH - 1;
+    int bird_top = bird->y - BIRD_MASK_TOP;
+
+    // Only on-screen pipes can touch the bird
+    for (unsigned int i = 0; i < pipes->visible; i++) {
+        Pipe *pipe = pipe_stream_get(pipes, i);
+        int x = pipe_x(pipes, pipe);
+
+        // Bounding box tests first, only pipes overlapping it reach the masks.
+        // Pipes are generated left to right, none after this one can reach the bird.
+        if (x > bird_right) {
+            break;
+        }
+        if (x + PIPE_WIDTH < bird_left) {
+            continue;
+        }
+
+        // Last bird row inside the top pipe and first bird row inside the bottom pipe
+        int top_row = pipe->top_height - 1 - bird_top;
+        int bottom_row = pipe->top_height + pipe->gap + 1 - bird_top;
+        if (top_row < 0 && bottom_row >= BIRD_MASK_HEIGHT) {
+            continue;  // Bounding box is entirely inside the gap
+        }
+        uint32_t columns = pipe_column_mask[x - bird_left + PIPE_WIDTH];
+
+        if (top_row >= 0) {
+            if (top_row > BIRD_MASK_HEIGHT - 1) top_row = BIRD_MASK_HEIGHT - 1;
+            if (bird_mask_above[top_row] & columns) {
+                return 1;  // Hit top pipe
+            }
+        }
+        if (bottom_row < BIRD_MASK_HEIGHT) {
+            if (bottom_row < 0) bottom_row = 0;
+            if (bird_mask_below[bottom_row] & columns) {
+                return 1;  // Hit bottom pipe
+            }
+        }
+    }
+    return 0;  // No collision
+}
+
+// Start a new run, keeping the high score
+void game_restart(GameState *game, uint32_t seed) {
+    initialize_bird(game);
+    pipe_stream_init(&game->pipes, seed, game->screen_x, game->screen_y);
+    game->scroll_accumulator = 0.0f;
+    game->score = 0;
+    game->game_over = 0;
+}
+
+void game_init(GameState *game, uint32_t seed, int screen_x, int screen_y) {
+    game->screen_x = screen_x;
+    game->screen_y = screen_y;
+    game->high_score = 0;
+    game->tick = 0;
+    game_restart(game, seed);
+}
+
+// Advance the simulation by one frame. keys holds the KEY_* bits held this tick,
+// the returned EVENT_* bits tell the caller what happened. The next run's pipes
+// are seeded from the current stream so a whole session follows from one seed.
+int game_step(GameState *game, int keys) {
+    int events = 0;
+
+    game->tick++;
+    if (game->game_over) {
+        if (keys & KEY_RESTART) {  // KEY1 pressed
+            game_restart(game, game->pipes.rng);
+            events |= EVENT_RESTARTED;
+        }
+        return events;
+    }
+
+    // Move pipes left by SCROLL_SPEED pixels
+    game->scroll_accumulator += (float)SCROLL_SPEED / SCROLL_SPEED_MULTIPLIER;
+    
+    // Only move pipes when we've accumulated at least 1 pixel of movement
+    if (game->scroll_accumulator >= 1.0f) {
+        int pixels_to_move = (int)game->scroll_accumulator;
+        game->scroll_accumulator -= pixels_to_move;
+        
+        // Retires pipes that left the screen and generates ahead as needed
+        pipe_stream_advance(&game->pipes, pixels_to_move);
+    }
+
+    update_bird(game, keys);
+    events |= update_score(game);
+
+    if (check_collision(&game->pipes, &game->bird)) {
+        game->game_over = 1;
+        // Update high score if current score is higher
+        if (game->score > game->high_score) {
+            game->high_score = game->score;
+        }
+        events |= EVENT_GAME_OVER;
+    }
+    return events;
+}
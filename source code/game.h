@@ -0,0 +1,57 @@
+#ifndef GAME_H_
+#define GAME_H_
+
+#include <stdint.h>
+#include "pipes.h"
+
+#define BIRD_BODY_WIDTH 18
+#define BIRD_BODY_HEIGHT 20
+#define BIRD_HEAD_SIZE 15
+#define BIRD_BEAK_SIZE 6
+#define BIRD_MASK_TOP (BIRD_BODY_HEIGHT/2 + BIRD_HEAD_SIZE/2)  // Rows from head top to bird.y
+#define BIRD_MASK_WIDTH (BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2 + BIRD_BEAK_SIZE + 1)  // 32 columns, one bit each
+#define BIRD_MASK_HEIGHT (BIRD_MASK_TOP + BIRD_BODY_HEIGHT/2 + 1)
+#define SCROLL_SPEED_MULTIPLIER 10  // Use multiples of 10 for precision
+#define SCROLL_SPEED 5.5              // 5 = 0.5 pixels per frame when divided by SCROLL_SPEED_MULTIPLIER
+#define GRAVITY_MULTIPLIER 10
+#define GRAVITY_SPEED 5        // 0.5 pixels per frame when divided by GRAVITY_MULTIPLIER
+#define BOTTOM_MARGIN 1      // How far from bottom before stopping fall
+#define FLAP_DISTANCE 6      // Pixels the bird rises when KEY0 is pressed
+
+// Input bits, same layout as the value read from /dev/KEY
+#define KEY_FLAP 0x1         // KEY0
+#define KEY_RESTART 0x2      // KEY1
+
+// Events reported by game_step() for the caller to act on (sound, text)
+#define EVENT_SCORED 0x1
+#define EVENT_GAME_OVER 0x2
+#define EVENT_RESTARTED 0x4
+
+typedef struct {
+    int x;          // X position of bird's body left edge
+    int y;          // Y position of bird's center
+    int velocity;   // For later use with gravity
+    float fall_accumulator;  // For smooth falling movement
+} Bird;
+
+// Everything one simulation tick reads and writes. It holds no pointers, so a
+// plain struct copy is a complete snapshot of the game.
+typedef struct {
+    Bird bird;
+    PipeStream pipes;
+    float scroll_accumulator;
+    int score;
+    int high_score;
+    int game_over;
+    unsigned long tick;     // Ticks simulated since game_init()
+    int screen_x, screen_y;
+} GameState;
+
+// Function prototypes
+void build_bird_mask(void);
+void game_init(GameState *game, uint32_t seed, int screen_x, int screen_y);
+void game_restart(GameState *game, uint32_t seed);
+int game_step(GameState *game, int keys);
+int check_collision(PipeStream *pipes, const Bird *bird);
+
+#endif /* GAME_H_ */
@@ -0,0 +1,56 @@
+#include <stdio.h>
+#include <string.h>
+#include "governor.h"
+
+void governor_init(Governor *governor, long long budget_ns, int max_level) {
+    memset(governor, 0, sizeof(*governor));
+    governor->budget_ns = budget_ns;
+    governor->max_level = max_level;
+    governor->settle = GOVERNOR_SETTLE_FRAMES;  // First frames warm caches, don't judge them
+}
+
+// Account for one drawn frame and pick the level of the next one. Drops one
+// level at a time, waiting for each to settle, so a single slow frame costs
+// the least quality that keeps up. interval_ns is the wall time since the
+// previous update.
+void governor_update(Governor *governor, long long work_ns, long long interval_ns) {
+    if (governor->level > 0) {
+        governor->degraded++;
+    }
+    if (work_ns > governor->budget_ns) {
+        governor->overruns++;
+        governor->calm_ns = 0;
+    } else if (work_ns * 100 < governor->budget_ns * GOVERNOR_HEADROOM_PERCENT) {
+        governor->calm_ns += interval_ns;
+    } else {
+        governor->calm_ns = 0;
+    }
+
+    if (governor->settle > 0) {
+        governor->settle--;
+        return;
+    }
+    if (work_ns > governor->budget_ns && governor->level < governor->max_level) {
+        governor->level++;
+        governor->downgrades++;
+        governor->settle = GOVERNOR_SETTLE_FRAMES;
+        if (governor->level > governor->lowest) {
+            governor->lowest = governor->level;
+        }
+    } else if (governor->calm_ns >= GOVERNOR_RESTORE_NANOSECONDS && governor->level > 0) {
+        governor->level--;
+        governor->upgrades++;
+        governor->settle = GOVERNOR_SETTLE_FRAMES;
+        governor->calm_ns = 0;
+    }
+}
+
+void governor_print_stats(const Governor *governor) {
+    if (governor->max_level == 0) {
+        return;
+    }
+    printf("Governor: %lu overruns, %lu frames degraded, %lu states skipped, "
+           "%lu downgrades, %lu upgrades, lowest level %d of %d\n",
+           governor->overruns, governor->degraded, governor->skipped,
+           governor->downgrades, governor->upgrades, governor->lowest, governor->max_level);
+}
@@ -0,0 +1,32 @@
+#ifndef GOVERNOR_H_
+#define GOVERNOR_H_
+
+#define GOVERNOR_SETTLE_FRAMES 8      // Frames drawn at a new level before it is judged
+#define GOVERNOR_RESTORE_NANOSECONDS 2000000000LL  // Unbroken time with headroom before stepping back up
+#define GOVERNOR_HEADROOM_PERCENT 50  // Work below this share of the budget counts as headroom
+
+// Render quality governor. Each frame's drawing work, without the time spent
+// waiting for the VGA controller, is checked against the tick period. An
+// overrun lowers the quality by one level, a long enough stretch of cheap
+// frames raises it again. That stretch is timed rather than counted in frames,
+// since the frame rate depends on the VGA controller and the current level.
+// What each level drops is up to the caller. Only used from the render thread.
+typedef struct {
+    long long budget_ns;        // Drawing work allowed per frame
+    int max_level;              // Lowest quality, 0 disables the governor
+    int level;                  // 0 is full quality
+    int settle;                 // Frames left before the current level is judged
+    long long calm_ns;          // Time since the last frame without headroom
+    unsigned long overruns;     // Frames whose work exceeded the budget
+    unsigned long degraded;     // Frames drawn below full quality
+    unsigned long skipped;      // States not drawn at all to save time
+    unsigned long downgrades, upgrades;
+    int lowest;                 // Worst level reached
+} Governor;
+
+// Function prototypes
+void governor_init(Governor *governor, long long budget_ns, int max_level);
+void governor_update(Governor *governor, long long work_ns, long long interval_ns);
+void governor_print_stats(const Governor *governor);
+
+#endif /* GOVERNOR_H_ */
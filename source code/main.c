@@ -6,102 +6,151 @@
 #include <signal.h>
 #include <time.h>
 #include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <getopt.h>
 #include "audio.h"
 #include "physical.h"
+#include "pipes.h"
+#include "game.h"
+#include "snapshot.h"
+#include "profiler.h"
+#include "parallax.h"
+#include "replay.h"
+#include "capture.h"
+#include "bot.h"
+#include "race.h"
+#include "governor.h"
 
-#define BIRD_BODY_WIDTH 18
-#define BIRD_BODY_HEIGHT 20
-#define BIRD_HEAD_SIZE 15
-#define BIRD_BEAK_SIZE 6
 #define BIRD_COLOR 0xFFE0
+#define BIRD_WING_COLOR 0xE5A0
+#define BIRD_BEAK_COLOR 0xFD20
+#define BIRD_EYE_COLOR 0x0000
+#define SPRITE_KEY 0xF81F     // Transparent pixels in uploaded sprites
+#define BIRD_SPRITE 0         // First of the BIRD_FRAMES sprite ids in the driver
+#define BIRD_FRAMES 3         // Wing up, level and down
+#define BIRD_FRAME_TICKS 6    // Ticks each animation frame is shown
+#define GHOST_TINT 0x867F     // Ghost birds are blended halfway to this color
 #define VIDEO_BYTES 8         // Number of characters to read from /dev/video
-#define PIPE_WIDTH 20         // Width of each pipe
-#define MAX_PIPES 4           // Total number of pipes
-#define GAP_SIZE 60           // Space for bird to pass through
-#define MIN_PIPE_HEIGHT 100   // Minimum height for the top pipe section
-#define MAX_PIPE_HEIGHT_DIFF 40 // Maximum allowed difference in height between pipes
-#define FRAME_DELAY_NANOSECONDS 16666667  // Delay between frames (~50 ms for smooth animation)
-#define SCROLL_SPEED_MULTIPLIER 10  // Use multiples of 10 for precision
-#define SCROLL_SPEED 5.5              // 5 = 0.5 pixels per frame when divided by SCROLL_SPEED_MULTIPLIER
+#define FRAME_DELAY_NANOSECONDS 16666667  // Simulation tick period (60 Hz)
 #define COMMAND_BUFFER_SIZE 2048
-#define GRAVITY_MULTIPLIER 10
-#define GRAVITY_SPEED 5        // 0.5 pixels per frame when divided by GRAVITY_MULTIPLIER
-#define BOTTOM_MARGIN 1      // How far from bottom before stopping fall
-#define JUMP_SPEED -2        // Negative because up is lower Y values
-#define MAX_FALL_SPEED 2     // Maximum falling speed
 #define GAME_OVER_X 52       // Adjusted for "GAME OVER" centering
 #define RESTART_X 30         // Adjusted for "PRESS KEY1 to restart" centering
 #define GAME_OVER_Y 35       // Middle of screen
 #define RESTART_Y 40       // Line below game over
+#define LABEL_GAME_OVER 8    // Sprite ids of the text labels cached in the driver
+#define LABEL_RESTART 9
+#define LABEL_HIGH_SCORE 10
+#define LABEL_SCORE 11
+#define MAX_LABELS 16
+#define LABEL_COLOR 0xFFFF
+#define LABEL_ADVANCE 6      // Driver font glyph width plus spacing
+#define LABEL_HEIGHT 7       // Driver font glyph height
+#define GAME_OVER_DIM 14     // Weight out of 32 of the black blended over the frozen playfield
+#define PANEL_COLOR 0x0000   // Translucent backing behind the labels
+#define PANEL_ALPHA 12       // Weight out of 32 of PANEL_COLOR
+#define PANEL_MARGIN 4
+#define SKY_BANDS 8           // Horizontal bands of the background sky gradient
+#define BENCHMARK_FRAMES 600 // Frames timed per layer count by --bench-layers
+#define HEADLESS_WIDTH 320    // Screen simulated by --fast --autopilot, the VGA default
+#define HEADLESS_HEIGHT 240
 #define HEX_DEVICE "/dev/HEX"
+#define NANOSECONDS_PER_SECOND 1000000000L
+// Simulation rate, checked against replays. Rounded, the tick period isn't a whole number of ns.
+#define TICK_HZ ((NANOSECONDS_PER_SECOND + FRAME_DELAY_NANOSECONDS / 2) / FRAME_DELAY_NANOSECONDS)
 
-
-// Structure to represent each pipe's position and dimensions
-typedef struct {
-    int x;          // X position of the pipe
-    int top_height; // Height of the top section of the pipe
-} Pipe;
-
+// Time accounting for one pipeline thread, reported when the game exits
 typedef struct {
-    int x;          // X position of bird's body left edge
-    int y;          // Y position of bird's center
-    int velocity;   // For later use with gravity
-    float fall_accumulator;  // For smooth falling movement
-} Bird;
-
-Bird bird;
+    unsigned long iterations;   // Ticks simulated or frames rendered
+    long long busy_ns;          // Time spent working, excluding waits and sleeps
+    long long latency_ns;       // Render only: sum of tick start to swap done
+    long long max_latency_ns;
+    unsigned long skipped;      // Render only: published states never drawn
+    struct timespec cpu_time;   // Thread CPU time at exit, includes driver spinning
+} ThreadStats;
 
-Pipe pipes[MAX_PIPES];
+GameState game;          // Owned by the simulation thread
+Snapshot snapshot;       // Simulation to render hand-off
+ThreadStats sim_stats, render_stats;
 volatile sig_atomic_t stop = 0;  // Signal flag for Ctrl+C
 int screen_x, screen_y;  // Variables for screen dimensions
-float scroll_accumulator = 0.0f;
 static char draw_command_buffer[COMMAND_BUFFER_SIZE];
 static int draw_command_count = 0;
-int score = 0;
-int passed_pipes[MAX_PIPES] = {0};  // Track which pipes we've passed
+static unsigned short bird_frames[BIRD_FRAMES][BIRD_MASK_HEIGHT][BIRD_MASK_WIDTH];
+static int bird_sprites_loaded = 0;  // Driver accepted the sprites, otherwise draw boxes
+static int labels_loaded = 0;        // Text goes to the pixel buffer, otherwise the character buffer
+static int blend_supported = 0;      // Driver draws translucent boxes for the dim and the panels
+static int label_widths[MAX_LABELS]; // Pixel width of each label id, for centering
+static int background_saved = 0;     // Frames restore the cached background, otherwise clear
+static int background_dimmed = 0;    // Cached background holds the dimmed game over playfield
+static int parallax_layers = 0;      // Scrolling layers the driver composes over the background
+static int lowres = 0;               // Driver draws at half resolution and upscales each frame
+static Replay input_log;             // Key input being recorded or played back, if file is set
+static Capture capture;              // Presented frames streamed to a file, if file is set
+static int autopilot = 0;            // Keys come from the search bot instead of the buttons
+static Bot bot;
+static Race race;                    // Ghosts flying the player's course, if count is set
+static RaceFrame race_frame;
+static Governor governor;            // Render quality, levels drop parallax layers then every other state
 int fd_hex;  // File descriptor for HEX device
-int high_score = 0;
 void* audio_virtual_base = NULL;
 int fd = -1;  // File descriptor for /dev/mem
 
 void catchSIGINT(int signum);
-void initialize_pipes(void);
+int send_command(int fd, const char *format, ...);
 void safe_draw_box(int fd, int x1, int y1, int x2, int y2, short int color);
 void flush_draw_commands(int fd);
-void draw_pipe(int fd, Pipe pipe);
-void update_and_draw_pipes(int fd);
-void initialize_bird(void);
-void draw_bird(int fd);
-void update_bird(void);
+void draw_pipe(int fd, int x, const Pipe *pipe);
+void draw_bird(int fd, const GameState *frame);
+void draw_birds(int fd, const GameState *frame, const RaceFrame *race);
+void build_bird_sprites(void);
+int upload_bird_sprites(int fd);
+long long render_frame(int fd, GameState *frame, const RaceFrame *race);
 int read_key_input(void);
-int check_collision(void);
-void restart_game(void);
 void clear_text(int fd);
-void display_game_over(int fd);
+void display_game_over(int fd, const GameState *frame);
+int create_label(int fd, int id, int scale, const char *text);
+void draw_label(int fd, int id, int y);
+void draw_panel(int fd, int width, int y1, int y2);
+int create_static_labels(int fd);
+int save_background(int fd);
+void draw_labels(int fd, const GameState *frame);
+void *simulation_thread(void *arg);
+void print_pipeline_stats(const struct timespec *start);
+void print_replay_result(void);
+int fast_replay(void);
+int fast_autopilot(uint32_t seed);
 
-// Signal handler for SIGINT (Ctrl+C)
+// Signal handler for SIGINT (Ctrl+C). Cleanup happens at the end of main()
+// once both threads have stopped using the mappings.
 void catchSIGINT(int signum) {
     stop = 1;  // Set the flag to stop the game loop
+}
 
-    if (audio_virtual_base != NULL) {
-        unmap_physical(audio_virtual_base, AUDIO_SPAN);
-        audio_virtual_base = NULL;
-    }
-
-    if (fd != -1) {
-        close_physical(fd);
-        fd = -1;
-    }
+static long long elapsed_ns(const struct timespec *from, const struct timespec *to) {
+    return (long long)(to->tv_sec - from->tv_sec) * NANOSECONDS_PER_SECOND +
+           (to->tv_nsec - from->tv_nsec);
 }
 
+// Format and write one driver command, timing the two halves separately
+int send_command(int fd, const char *format, ...) {
+    char command[128];
+    va_list args;
+    uint64_t start = profile_start();
 
+    va_start(args, format);
+    int len = vsnprintf(command, sizeof(command), format, args);
+    va_end(args);
+    if (len >= (int)sizeof(command)) {
+        len = sizeof(command) - 1;
+    }
+    profile_add(PROFILE_FORMAT, start);
 
-void initialize_bird() {
-    // Position bird slightly to the right and in the middle of screen
-    bird.x = screen_x / 3;
-    bird.y = screen_y / 2;
-    bird.velocity = 0;  // Start with no vertical velocity
-    bird.fall_accumulator = 0.0f;
+    start = profile_start();
+    int ret = write(fd, command, len);
+    profile_add(PROFILE_DRAW, start);
+    return ret;
 }
 
 void display_on_hex(int fd, int value) {
@@ -109,33 +158,138 @@ void display_on_hex(int fd, int value) {
     snprintf(buffer, sizeof(buffer), "%06d\n", value);
     write(fd, buffer, strlen(buffer));
 }
+// Fill a box given relative to (bird.x, bird.y), inclusive, in one animation frame
+static void sprite_box(int frame, int x1, int y1, int x2, int y2, unsigned short color) {
+    for (int y = y1; y <= y2; y++) {
+        for (int x = x1; x <= x2; x++) {
+            bird_frames[frame][y + BIRD_MASK_TOP][x] = color;
+        }
+    }
+}
+
+// Pre-rasterize the bird animation. The silhouette is the same body, head and
+// beak boxes the collision mask is built from, the wing and eye only recolor it.
+void build_bird_sprites() {
+    for (int frame = 0; frame < BIRD_FRAMES; frame++) {
+        for (int y = 0; y < BIRD_MASK_HEIGHT; y++) {
+            for (int x = 0; x < BIRD_MASK_WIDTH; x++) {
+                bird_frames[frame][y][x] = SPRITE_KEY;
+            }
+        }
+
+        sprite_box(frame, 0, -BIRD_BODY_HEIGHT/2, BIRD_BODY_WIDTH, BIRD_BODY_HEIGHT/2, BIRD_COLOR);
+        sprite_box(frame, BIRD_BODY_WIDTH - BIRD_HEAD_SIZE/2,
+                   -BIRD_BODY_HEIGHT/2 - BIRD_HEAD_SIZE/2,
+                   BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2,
+                   -BIRD_BODY_HEIGHT/2 + BIRD_HEAD_SIZE/2, BIRD_COLOR);
+        sprite_box(frame, BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2,
+                   -BIRD_BODY_HEIGHT/2 - BIRD_BEAK_SIZE/2,
+                   BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2 + BIRD_BEAK_SIZE,
+                   -BIRD_BODY_HEIGHT/2 + BIRD_BEAK_SIZE/2, BIRD_BEAK_COLOR);
+
+        // Eye near the back of the head
+        sprite_box(frame, BIRD_BODY_WIDTH + 1, -BIRD_BODY_HEIGHT/2 - 4,
+                   BIRD_BODY_WIDTH + 2, -BIRD_BODY_HEIGHT/2 - 3, BIRD_EYE_COLOR);
+
+        // Wing moves down 5 pixels per frame
+        sprite_box(frame, 2, -8 + frame * 5, 10, -4 + frame * 5, BIRD_WING_COLOR);
+    }
+}
+
+// Send each animation frame to the driver's sprite store in one write
+int upload_bird_sprites(int fd) {
+    char command[64 + sizeof(bird_frames[0])];
+
+    for (int frame = 0; frame < BIRD_FRAMES; frame++) {
+        int len = snprintf(command, 64, "sprite %d,%d,%d 0x%X\n",
+                           BIRD_SPRITE + frame, BIRD_MASK_WIDTH, BIRD_MASK_HEIGHT, SPRITE_KEY);
+        memcpy(command + len, bird_frames[frame], sizeof(bird_frames[frame]));
+        if (write(fd, command, len + sizeof(bird_frames[frame])) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Wing cycles up, level, down, level
+static const int wing_cycle[4] = {0, 1, 2, 1};
+
 // Function to draw the bird
-void draw_bird(int fd) {
+void draw_bird(int fd, const GameState *frame) {
+    const Bird *bird = &frame->bird;
+
+    if (bird_sprites_loaded) {
+        int wing = wing_cycle[(frame->tick / BIRD_FRAME_TICKS) % 4];
+        send_command(fd, "blit %d,%d,%d\n", BIRD_SPRITE + wing, bird->x, bird->y - BIRD_MASK_TOP);
+        return;
+    }
+
     // Draw body (rectangle)
     safe_draw_box(fd, 
-                 bird.x, 
-                 bird.y - BIRD_BODY_HEIGHT/2,
-                 bird.x + BIRD_BODY_WIDTH, 
-                 bird.y + BIRD_BODY_HEIGHT/2,
+                 bird->x, 
+                 bird->y - BIRD_BODY_HEIGHT/2,
+                 bird->x + BIRD_BODY_WIDTH, 
+                 bird->y + BIRD_BODY_HEIGHT/2,
                  BIRD_COLOR);
 
     // Draw head (square) - positioned at front of body
     safe_draw_box(fd,
-                 bird.x + BIRD_BODY_WIDTH - BIRD_HEAD_SIZE/2,
-                 bird.y - BIRD_BODY_HEIGHT/2 - BIRD_HEAD_SIZE/2,  // Position above body
-                 bird.x + BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2,
-                 bird.y - BIRD_BODY_HEIGHT/2 + BIRD_HEAD_SIZE/2,
+                 bird->x + BIRD_BODY_WIDTH - BIRD_HEAD_SIZE/2,
+                 bird->y - BIRD_BODY_HEIGHT/2 - BIRD_HEAD_SIZE/2,  // Position above body
+                 bird->x + BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2,
+                 bird->y - BIRD_BODY_HEIGHT/2 + BIRD_HEAD_SIZE/2,
                  BIRD_COLOR);
 
     // Draw beak (small square) - positioned at front of head
     safe_draw_box(fd,
-                 bird.x + BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2,
-                 bird.y - BIRD_BODY_HEIGHT/2 - BIRD_BEAK_SIZE/2,
-                 bird.x + BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2 + BIRD_BEAK_SIZE,
-                 bird.y - BIRD_BODY_HEIGHT/2 + BIRD_BEAK_SIZE/2,
+                 bird->x + BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2,
+                 bird->y - BIRD_BODY_HEIGHT/2 - BIRD_BEAK_SIZE/2,
+                 bird->x + BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2 + BIRD_BEAK_SIZE,
+                 bird->y - BIRD_BODY_HEIGHT/2 + BIRD_BEAK_SIZE/2,
                  BIRD_COLOR);
 }
 
+// Draw the ghosts and then the player in one "instances" write, so the driver
+// parses a single command however many birds are flying. Ghosts are tinted and
+// flap out of step with each other.
+void draw_birds(int fd, const GameState *frame, const RaceFrame *race) {
+    struct {
+        int16_t x, y;
+        uint16_t id, tint;
+    } records[MAX_GHOSTS + 1];
+    char command[32 + sizeof(records)];
+    const Bird *bird = &frame->bird;
+    int tick = frame->tick / BIRD_FRAME_TICKS;
+    int count = 0;
+
+    if (race->count == 0 || !bird_sprites_loaded) {
+        draw_bird(fd, frame);
+        return;
+    }
+
+    uint64_t start = profile_start();
+    for (int i = 0; i < race->count; i++) {
+        records[count].x = bird->x;
+        records[count].y = race->y[i] - BIRD_MASK_TOP;
+        records[count].id = BIRD_SPRITE + wing_cycle[(tick + i + 1) % 4];
+        records[count].tint = GHOST_TINT;
+        count++;
+    }
+    records[count].x = bird->x;
+    records[count].y = bird->y - BIRD_MASK_TOP;
+    records[count].id = BIRD_SPRITE + wing_cycle[tick % 4];
+    records[count].tint = 0;
+    count++;
+
+    int len = snprintf(command, 32, "instances %d\n", count);
+    memcpy(command + len, records, count * sizeof(records[0]));
+    profile_add(PROFILE_FORMAT, start);
+
+    start = profile_start();
+    write(fd, command, len + count * sizeof(records[0]));
+    profile_add(PROFILE_DRAW, start);
+}
+
 void clear_text(int fd) {
     char command[64];
     snprintf(command, sizeof(command), "erase\n");
@@ -143,24 +297,84 @@ void clear_text(int fd) {
 }
 
 // Function to display game over text
-void display_game_over(int fd) {
-    char command[64];
-    // Update high score if current score is higher
-    if (score > high_score) {
-        high_score = score;
+void display_game_over(int fd, const GameState *frame) {
+    send_command(fd, "text %d,%d GAME OVER\n", GAME_OVER_X, GAME_OVER_Y);
+    send_command(fd, "text %d,%d PRESS KEY1 to restart\n", RESTART_X, RESTART_Y);
+    // Add high score display (positioned 5 lines below restart text)
+    send_command(fd, "text %d,%d Highscore: %d\n", RESTART_X - 12, RESTART_Y + 5, frame->high_score);
+}
+
+// Screen pixels per font pixel of a label asked for at scale. In lowres mode
+// the driver halves the scale, keeping at least 1, and upscale doubles it
+// again, so odd scales round down and scale 1 comes out twice as large.
+static int label_scale(int scale) {
+    if (!lowres) {
+        return scale;
     }
+    return (scale > 1 ? scale / 2 : 1) * 2;
+}
 
-    snprintf(command, sizeof(command), "text %d,%d GAME OVER\n", 
-             GAME_OVER_X, GAME_OVER_Y);
-    write(fd, command, strlen(command));
-    
-    snprintf(command, sizeof(command), "text %d,%d PRESS KEY1 to restart\n", 
-             RESTART_X, RESTART_Y);
-    write(fd, command, strlen(command));
-    // Add high score display (positioned 5 lines below restart text)
-    snprintf(command, sizeof(command), "text %d,%d Highscore: %d\n", 
-             RESTART_X - 12, RESTART_Y + 5, high_score);
-    write(fd, command, strlen(command));
+// Rasterize text once into the driver's sprite store, redraw it with draw_label()
+int create_label(int fd, int id, int scale, const char *text) {
+    int shown = label_scale(scale);
+
+    if (send_command(fd, "label %d,%d 0x%X %s\n", id, scale, LABEL_COLOR, text) == -1) {
+        return -1;
+    }
+    label_widths[id] = (int)strlen(text) * LABEL_ADVANCE * shown - shown;
+    return 0;
+}
+
+// Blit a cached label horizontally centered on the screen
+void draw_label(int fd, int id, int y) {
+    send_command(fd, "blit %d,%d,%d\n", id, (screen_x - label_widths[id]) / 2, y);
+}
+
+// Darken the scene behind centered text width pixels wide on rows y1 to y2
+void draw_panel(int fd, int width, int y1, int y2) {
+    int x1 = (screen_x - width) / 2 - PANEL_MARGIN;
+
+    if (blend_supported) {
+        send_command(fd, "blend %d,%d %d,%d 0x%04X %d\n", x1, y1 - PANEL_MARGIN,
+                     x1 + width + 2 * PANEL_MARGIN - 1, y2 + PANEL_MARGIN, PANEL_COLOR, PANEL_ALPHA);
+    }
+}
+
+// Labels whose text never changes are rasterized once at startup
+int create_static_labels(int fd) {
+    if (create_label(fd, LABEL_GAME_OVER, 3, "GAME OVER") == -1) {
+        return -1;
+    }
+    return create_label(fd, LABEL_RESTART, 1, "PRESS KEY1 to restart");
+}
+
+// Draw the score, or the game over text, into the back buffer with the scene.
+// Score labels are only rasterized again when the value they show changes.
+void draw_labels(int fd, const GameState *frame) {
+    static int shown_score = -1, shown_high_score = -1;
+    char text[32];
+
+    if (frame->game_over) {
+        if (frame->high_score != shown_high_score) {
+            snprintf(text, sizeof(text), "Highscore: %d", frame->high_score);
+            create_label(fd, LABEL_HIGH_SCORE, 1, text);
+            shown_high_score = frame->high_score;
+        }
+        draw_panel(fd, label_widths[LABEL_GAME_OVER], screen_y / 2 - 3 * LABEL_HEIGHT - 10,
+                   screen_y / 2 + 3 * LABEL_HEIGHT + 9);
+        draw_label(fd, LABEL_GAME_OVER, screen_y / 2 - 3 * LABEL_HEIGHT - 10);
+        draw_label(fd, LABEL_RESTART, screen_y / 2);
+        draw_label(fd, LABEL_HIGH_SCORE, screen_y / 2 + 2 * LABEL_HEIGHT + 10);
+        return;
+    }
+
+    if (frame->score != shown_score) {
+        snprintf(text, sizeof(text), "%d", frame->score);
+        create_label(fd, LABEL_SCORE, 2, text);
+        shown_score = frame->score;
+    }
+    draw_panel(fd, label_widths[LABEL_SCORE], 8, 8 + 2 * LABEL_HEIGHT - 1);
+    draw_label(fd, LABEL_SCORE, 8);
 }
 
 int read_key_input() {
@@ -179,56 +393,6 @@ int read_key_input() {
     return 0;
 }
 
-void update_bird() {
-	
-    int key_input = read_key_input();
-    if (key_input & 0x1) {  // KEY0 pressed
-        // Move up 2 pixels immediately when button is pressed
-        bird.y -= 6;
-        // Reset fall accumulator to prevent immediate fall after jump
-        bird.fall_accumulator = 0.0f;
-    }
-    // Update falling movement
-    bird.fall_accumulator += (float)GRAVITY_SPEED / GRAVITY_MULTIPLIER;
-    
-    // Move bird down when we've accumulated enough for 1 pixel
-    if (bird.fall_accumulator >= 1.0f) {
-        int pixels_to_fall = (int)bird.fall_accumulator;
-        bird.fall_accumulator -= pixels_to_fall;
-        
-        // Only update Y if not at bottom of screen
-        if (bird.y + BIRD_BODY_HEIGHT/2 + pixels_to_fall < screen_y - BOTTOM_MARGIN) {
-            bird.y += pixels_to_fall;
-        }
-    }
-    // Keep bird within screen bounds
-    if (bird.y - BIRD_BODY_HEIGHT/2 < 0) {
-        bird.y = BIRD_BODY_HEIGHT/2;
-    }
-}
-
-
-// Function to initialize pipes with constrained height differences
-void initialize_pipes() {
-    srand(time(NULL));
-    int start_x = screen_x;  // Start pipes off the right edge of the screen
-    int previous_height = MIN_PIPE_HEIGHT + rand() % (screen_y - GAP_SIZE - MIN_PIPE_HEIGHT);
-
-    for (int i = 0; i < MAX_PIPES; i++) {
-        pipes[i].x = start_x + i * (PIPE_WIDTH + 60);  // Space pipes evenly to the right of the screen
-        
-        // Randomize height with a max difference constraint
-        int min_height = previous_height - MAX_PIPE_HEIGHT_DIFF;
-        int max_height = previous_height + MAX_PIPE_HEIGHT_DIFF;
-
-        if (min_height < MIN_PIPE_HEIGHT) min_height = MIN_PIPE_HEIGHT;
-        if (max_height > screen_y - GAP_SIZE) max_height = screen_y - GAP_SIZE;
-
-        pipes[i].top_height = min_height + rand() % (max_height - min_height + 1);
-        previous_height = pipes[i].top_height;  // Update previous height for the next pipe
-    }
-}
-
 // Function to safely draw a box within screen bounds
 void safe_draw_box(int fd, int x1, int y1, int x2, int y2, short int color) {
     // Ensure x and y values are within bounds
@@ -237,11 +401,7 @@ void safe_draw_box(int fd, int x1, int y1, int x2, int y2, short int color) {
     if (x2 >= screen_x) x2 = screen_x - 1;
     if (y2 >= screen_y) y2 = screen_y - 1;
    
-    char command[64];
-    int len = snprintf(command, sizeof(command), "box %d,%d %d,%d 0x%X\n", 
-                      x1, y1, x2, y2, color);
-    write(fd, command, len);
-   
+    send_command(fd, "box %d,%d %d,%d 0x%X\n", x1, y1, x2, y2, color);
 }
 
 // Don't forget to flush any remaining commands at the end of drawing
@@ -253,167 +413,419 @@ void flush_draw_commands(int fd) {
 }
   
 // Function to draw a single pipe with a top and bottom section
-void draw_pipe(int fd, Pipe pipe) {
+void draw_pipe(int fd, int x, const Pipe *pipe) {
     // Draw top section of the pipe
-    safe_draw_box(fd, pipe.x, 0, pipe.x + PIPE_WIDTH, pipe.top_height, 0x07E0);
+    safe_draw_box(fd, x, 0, x + PIPE_WIDTH, pipe->top_height, 0x07E0);
 
     // Draw bottom section of the pipe, ensuring it doesn't exceed screen height
-    int bottom_y_start = pipe.top_height + GAP_SIZE;
+    int bottom_y_start = pipe->top_height + pipe->gap;
     if (bottom_y_start < screen_y) {
-        safe_draw_box(fd, pipe.x, bottom_y_start, pipe.x + PIPE_WIDTH, screen_y - 1, 0x07E0);
+        safe_draw_box(fd, x, bottom_y_start, x + PIPE_WIDTH, screen_y - 1, 0x07E0);
     }
 }
 
-// Check if bird has collided with any pipe
-int check_collision() {
-    // Get bird boundaries considering head and beak
-    int bird_left = bird.x;
-    int bird_right = bird.x + BIRD_BODY_WIDTH + BIRD_HEAD_SIZE/2 + BIRD_BEAK_SIZE;
-    int bird_top = bird.y - BIRD_BODY_HEIGHT/2 - BIRD_HEAD_SIZE/2;  // Consider head position
-    int bird_bottom = bird.y + BIRD_BODY_HEIGHT/2;
-
-    // Check collision with each pipe
-    for (int i = 0; i < MAX_PIPES; i++) {
-        // If bird is within pipe's x-range
-        if (!(bird_right < pipes[i].x || bird_left > pipes[i].x + PIPE_WIDTH)) {
-            // Check if bird hits top pipe or bottom pipe
-            if (bird_top < pipes[i].top_height ||  // Hit top pipe
-                bird_bottom > pipes[i].top_height + GAP_SIZE) {  // Hit bottom pipe
-                return 1;  // Collision detected
-            }
+// Draw the static sky and ground once and cache it in the driver, so each
+// frame starts from a copy of it instead of a cleared buffer
+int save_background(int fd) {
+    int band_height = (screen_y - GROUND_HEIGHT + SKY_BANDS - 1) / SKY_BANDS;
+
+    for (int band = 0; band < SKY_BANDS; band++) {
+        int y1 = band * band_height;
+        int y2 = y1 + band_height - 1;
+        // Fade from deep blue at the top towards a pale horizon
+        int red = 4 + band * 2;
+        int green = 24 + band * 4;
+        int blue = 24 + band;
+
+        if (y2 >= screen_y - GROUND_HEIGHT) {
+            y2 = screen_y - GROUND_HEIGHT - 1;
         }
+        send_command(fd, "box %d,%d %d,%d 0x%04X\n", 0, y1, screen_x - 1, y2,
+                     (red << 11) | (green << 5) | blue);
     }
-    return 0;  // No collision
+    send_command(fd, "box %d,%d %d,%d 0x%04X\n", 0, screen_y - GROUND_HEIGHT,
+                 screen_x - 1, screen_y - 1, GROUND_COLOR);
+    send_command(fd, "box %d,%d %d,%d 0x%04X\n", 0, screen_y - GROUND_HEIGHT,
+                 screen_x - 1, screen_y - GROUND_HEIGHT + 2, GRASS_COLOR);
+    return (send_command(fd, "bg_save\n") < 0) ? -1 : 0;
 }
 
-// Function to restart the game
-void restart_game() {
-    pthread_mutex_lock(&audio_mutex); // Ensure no ongoing audio threads
-    pthread_mutex_unlock(&audio_mutex);
+// Write a command that waits for the VGA controller, returning how long it took
+static long long wait_command(int fd, const char *command) {
+    struct timespec start, end;
 
-    initialize_bird();
-    
-    // Reset pipes
-    initialize_pipes();
-    
-    // Reset accumulators
-    scroll_accumulator = 0.0f;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    write(fd, command, strlen(command));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return elapsed_ns(&start, &end);
+}
+
+// Draw one published game state and present it. Returns the time spent
+// drawing, without the waits for the VGA controller.
+long long render_frame(int fd, GameState *frame, const RaceFrame *race) {
+    static int text_shown = 0;  // Game over text is in the character buffer
+    struct timespec begin, end;
+    long long waited = 0;
+    uint64_t start;
 
-    score = 0;
-    for (int i = 0; i < MAX_PIPES; i++) {
-        passed_pipes[i] = 0;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    draw_command_count = 0;
+    start = profile_start();
+    if (background_dimmed && !frame->game_over) {
+        // New game, cache the plain sky and ground again
+        save_background(fd);
+        background_dimmed = 0;
     }
-    display_on_hex(fd_hex, score);  // Reset HEX display when game restarts
-    static int game_over_sound_played = 0; 
-    game_over_sound_played = 0; // Reset the flag
-}
+    if (background_saved) {
+        write(fd, "restore\n", 8);
+    } else {
+        write(fd, "clear\n", 6);
+    }
+    profile_stop(PROFILE_CLEAR, start);
+    start = profile_start();
+    waited += wait_command(fd, "sync\n");
+    profile_add(PROFILE_SYNC, start);
 
-void update_score() {
-    for (int i = 0; i < MAX_PIPES; i++) {
-        // Check if bird has fully passed this pipe and hasn't been counted yet
-        if (!passed_pipes[i] && 
-            bird.x > (pipes[i].x + PIPE_WIDTH)) {
-            score++;
-            passed_pipes[i] = 1;
-	        start_coin_sound(audio_virtual_base);
+    // Once the game is over the playfield is frozen and already in the restored background
+    if (!background_dimmed) {
+        // Clouds, city and ground scroll behind the pipes at fractions of their
+        // speed, the governor drops them front to back when frames overrun
+        int layers = parallax_layers - governor.level;
+        if (layers > 0) {
+            send_command(fd, "parallax %llu %d\n",
+                         (unsigned long long)parallax_scroll(frame->pipes.scroll, frame->scroll_accumulator),
+                         layers);
         }
-        
-        // Reset passed flag when pipe STARTS to wrap around, not after it's completely off screen
-        if (pipes[i].x >= screen_x) {  // When pipe resets to right side
-            passed_pipes[i] = 0;  // Reset flag so we can count it again
+
+        // Draw the on-screen pipes, frozen behind the text once the game is over
+        for (unsigned int i = 0; i < frame->pipes.visible; i++) {
+            Pipe *pipe = pipe_stream_get(&frame->pipes, i);
+            draw_pipe(fd, pipe_x(&frame->pipes, pipe), pipe);
+        }
+        draw_birds(fd, frame, race);
+
+        // Dim the frozen playfield so the game over text stands out. Blending reads
+        // the back buffer over the FPGA bridge, so with a cached background it is
+        // done once and the dimmed frame saved, later frames only restore it.
+        if (frame->game_over && blend_supported) {
+            send_command(fd, "blend 0,0 %d,%d 0x0000 %d\n", screen_x - 1, screen_y - 1, GAME_OVER_DIM);
+            if (background_saved) {
+                background_dimmed = (send_command(fd, "bg_save\n") >= 0);
+            }
         }
     }
-}
 
-// Function to update pipe positions and redraw them
-void update_and_draw_pipes(int fd) {
-    static int game_over = 0;  // Track game over state
-    static int game_over_sound_played = 0; // Track if the sound was played
+    // Text is composited into the back buffer and flipped with the frame
+    if (labels_loaded) {
+        draw_labels(fd, frame);
+    } else if (frame->game_over) {
+        display_game_over(fd, frame);
+        text_shown = 1;
+    } else if (text_shown) {
+        clear_text(fd);
+        text_shown = 0;
+    }
 
-    
-    draw_command_count = 0;
-    write(fd, "clear\n", 6);
-    write(fd, "sync\n", 5);
-    if (game_over) {
-        display_game_over(fd);
-	// Play the "game over" sound only once
-        if (!game_over_sound_played) {
-            play_game_over_sound(audio_virtual_base);
-            game_over_sound_played = 1; // Mark as played
-        }
-        
-        int key_input = read_key_input();
-        if (key_input & 0x2) {  // KEY1 pressed
-            game_over = 0;
-	    game_over_sound_played = 0;
-            clear_text(fd);
-            restart_game();
-        }
-        
-        // Always end frame with sync and swap
-        write(fd, "sync\n", 5);
-        write(fd, "swap\n", 5);
-        return;
+    flush_draw_commands(fd);
+    if (lowres) {
+        send_command(fd, "upscale\n");
     }
+    profile_commit(PROFILE_FORMAT);
+    profile_commit(PROFILE_DRAW);
     
-    // Move pipes left by SCROLL_SPEED pixels
-    scroll_accumulator += (float)SCROLL_SPEED / SCROLL_SPEED_MULTIPLIER;
+    start = profile_start();
+    waited += wait_command(fd, "sync\n");
+    profile_stop(PROFILE_SYNC, start);
     
-    // Only move pipes when we've accumulated at least 0.5 pixels of movement
-    if (scroll_accumulator >= 1.0f) {
-        int pixels_to_move = (int)scroll_accumulator;
-        scroll_accumulator -= pixels_to_move;
-        
-        for (int i = 0; i < MAX_PIPES; i++) {
-            pipes[i].x -= pixels_to_move;
-            if (pipes[i].x + PIPE_WIDTH < 0) {
-                pipes[i].x = screen_x;
-                pipes[i].top_height = MIN_PIPE_HEIGHT + 
-                    rand() % (screen_y - GAP_SIZE - MIN_PIPE_HEIGHT);
+    start = profile_start();
+    waited += wait_command(fd, "swap\n");
+    profile_stop(PROFILE_SWAP, start);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return elapsed_ns(&begin, &end) - waited;
+}
+
+// Simulation thread: one game_step() per FRAME_DELAY_NANOSECONDS on an absolute
+// schedule, publishing every tick while the render thread draws the previous one.
+void *simulation_thread(void *arg) {
+    struct timespec next, start, end;
+    uint64_t stage_start;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!stop) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        stage_start = profile_start();
+        int keys;
+        if (input_log.file && !input_log.recording) {
+            keys = replay_next(&input_log);
+            if (keys < 0) {
+                stop = 1;  // End of the replay
+                break;
+            }
+        } else {
+            keys = autopilot ? bot_decide(&bot, &game) : read_key_input();
+            if (input_log.file) {
+                replay_record(&input_log, keys);
             }
         }
+        profile_stop(PROFILE_INPUT, stage_start);
+
+        stage_start = profile_start();
+        int events = game_step(&game, keys);
+        profile_stop(PROFILE_UPDATE, stage_start);
+
+        // Every run of a race starts on the same course, ghosts freeze while the game is over.
+        // Bot ghosts share what the autopilot leaves of the tick's node budget.
+        if (race.count > 0) {
+            if (events & EVENT_RESTARTED) {
+                game_restart(&game, race.seed);
+                race_start(&race, &game);
+            }
+            if (!game.game_over) {
+                race_step(&race, &race_frame, BOT_TICK_BUDGET - (autopilot ? BOT_NODE_BUDGET : 0));
+            }
+        }
+
+        if (events & EVENT_SCORED) {
+            start_coin_sound(audio_virtual_base);
+        }
+        if (events & EVENT_RESTARTED) {
+            pthread_mutex_lock(&audio_mutex); // Ensure no ongoing audio threads
+            pthread_mutex_unlock(&audio_mutex);
+        }
+        stage_start = profile_start();
+        snapshot_publish(&snapshot, &game, race.count ? &race_frame : NULL, &start);
+        profile_stop(PROFILE_PUBLISH, stage_start);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sim_stats.busy_ns += elapsed_ns(&start, &end);
+        sim_stats.iterations++;
+
+        // Blocks for the length of the tune, the game over frame is already published
+        if (events & EVENT_GAME_OVER) {
+            play_game_over_sound(audio_virtual_base);
+        }
+
+        next.tv_nsec += FRAME_DELAY_NANOSECONDS;
+        if (next.tv_nsec >= NANOSECONDS_PER_SECOND) {
+            next.tv_nsec -= NANOSECONDS_PER_SECOND;
+            next.tv_sec++;
+        }
+        // Resynchronize after a long stall instead of bursting through missed ticks
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (elapsed_ns(&next, &end) > FRAME_DELAY_NANOSECONDS) {
+            next = end;
+        }
+        stage_start = profile_start();
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        profile_stop(PROFILE_SLEEP, stage_start);
     }
-    // Update bird position
-    update_bird();
-    update_score(); 
-    // Check for collision
-     if (check_collision()) {
-        game_over = 1;
-        display_game_over(fd);
-        write(fd, "sync\n", 5);
-        write(fd, "swap\n", 5);
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &sim_stats.cpu_time);
+    snapshot_close(&snapshot);
+    return NULL;
+}
+
+// Report per-thread utilization and tick-to-display latency
+void print_pipeline_stats(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double wall_ns = (double)elapsed_ns(start, &now);
+    struct timespec zero = {0, 0};
+
+    if (wall_ns <= 0) {
         return;
     }
+    printf("Simulation thread: %lu ticks, busy %.1f%%, cpu %.1f%%\n",
+           sim_stats.iterations, 100.0 * sim_stats.busy_ns / wall_ns,
+           100.0 * elapsed_ns(&zero, &sim_stats.cpu_time) / wall_ns);
+    printf("Render thread: %lu frames, %lu states skipped, busy %.1f%%, cpu %.1f%%\n",
+           render_stats.iterations, render_stats.skipped,
+           100.0 * render_stats.busy_ns / wall_ns,
+           100.0 * elapsed_ns(&zero, &render_stats.cpu_time) / wall_ns);
+    if (render_stats.iterations > 0) {
+        printf("Frame latency: avg %.2f ms, max %.2f ms\n",
+               render_stats.latency_ns / 1e6 / render_stats.iterations,
+               render_stats.max_latency_ns / 1e6);
+    }
+}
 
-    // Draw all pipes
-    for (int i = 0; i < MAX_PIPES; i++) {
-        draw_pipe(fd, pipes[i]);
+// Final state of a recorded or replayed run, equal checksums mean the replay reproduced it
+void print_replay_result(void) {
+    printf("Final state: tick %lu, score %d, high score %d, checksum %08X\n",
+           game.tick, game.score, game.high_score, replay_checksum(&game));
+}
+
+// Play the input log back as fast as the simulation runs, without opening any
+// devices, playing sound or rendering
+int fast_replay(void) {
+    struct timespec start, end;
+    int keys;
+
+    build_bird_mask();
+    game_init(&game, input_log.header.seed, input_log.header.screen_x, input_log.header.screen_y);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while ((keys = replay_next(&input_log)) >= 0) {
+        game_step(&game, keys);
     }
-    draw_bird(fd);
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
-    flush_draw_commands(fd);
-    
-    write(fd, "sync\n", 5);
-    
-    write(fd, "swap\n", 5);
-    
+    long long ns = elapsed_ns(&start, &end);
+    printf("Replayed %lu ticks in %.3f s (%.0f ticks/s)\n", game.tick, ns / 1e9,
+           ns > 0 ? game.tick * 1e9 / ns : 0.0);
+    print_replay_result();
+    replay_close(&input_log);
+    return 0;
 }
 
-// Clear the entire screen (used on program exit)
-//void clear_entire_screen(int fd) {
-    // Clear both buffers
-    //write(fd, "clear_all\n", 10);
-//}
+// Let the autopilot play without devices or a frame schedule until Ctrl+C,
+// counting the runs it loses
+int fast_autopilot(uint32_t seed) {
+    struct timespec start, end;
+    unsigned long deaths = 0;
 
+    signal(SIGINT, catchSIGINT);
+    build_bird_mask();
+    game_init(&game, seed, HEADLESS_WIDTH, HEADLESS_HEIGHT);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!stop) {
+        int keys = bot_decide(&bot, &game);
+        if (input_log.file) {
+            replay_record(&input_log, keys);
+        }
+        if (game_step(&game, keys) & EVENT_GAME_OVER) {
+            deaths++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
 
+    long long ns = elapsed_ns(&start, &end);
+    printf("Simulated %lu ticks in %.3f s, %lu deaths, high score %d\n", game.tick, ns / 1e9,
+           deaths, game.high_score);
+    bot_print_stats("Autopilot", &bot);
+    if (input_log.file) {
+        print_replay_result();
+        replay_close(&input_log);
+    }
+    return 0;
+}
 
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--profile] [--bench-layers] [--lowres] "
+            "[--autopilot] [--record FILE | --replay FILE] [--fast] [--capture FILE]\n"
+            "       [--ghost FILE]... [--bots N]\n", program);
+    fprintf(stderr, "  -p, --profile        time each frame stage, dump histograms on SIGUSR1 and at exit\n");
+    fprintf(stderr, "  -b, --bench-layers   measure the fill rate of 0 to %d parallax layers and exit\n",
+            PARALLAX_LAYERS);
+    fprintf(stderr, "  -l, --lowres         render at half resolution, the driver pixel-doubles each frame\n");
+    fprintf(stderr, "  -r, --record FILE    save the seed and every tick's keys to FILE\n");
+    fprintf(stderr, "  -R, --replay FILE    play a recorded run back instead of reading the keys\n");
+    fprintf(stderr, "  -a, --autopilot      let a search bot press the keys, restarting after each game over\n");
+    fprintf(stderr, "  -f, --fast           with --replay or --autopilot, simulate as fast as possible without devices\n");
+    fprintf(stderr, "  -c, --capture FILE   stream every presented frame, delta and run-length encoded, to FILE\n");
+    fprintf(stderr, "  -g, --ghost FILE     race the first run recorded in FILE, may be repeated\n");
+    fprintf(stderr, "  -n, --bots N         race N autopilot ghosts, up to %d ghosts in all\n", MAX_GHOSTS);
+}
 
 int main(int argc, char *argv[]) {
+    static const struct option options[] = {
+        {"profile", no_argument, NULL, 'p'},
+        {"bench-layers", no_argument, NULL, 'b'},
+        {"lowres", no_argument, NULL, 'l'},
+        {"record", required_argument, NULL, 'r'},
+        {"replay", required_argument, NULL, 'R'},
+        {"fast", no_argument, NULL, 'f'},
+        {"capture", required_argument, NULL, 'c'},
+        {"autopilot", no_argument, NULL, 'a'},
+        {"ghost", required_argument, NULL, 'g'},
+        {"bots", required_argument, NULL, 'n'},
+        {NULL, 0, NULL, 0}
+    };
+    int profile = 0;
+    int bench_layers = 0;
+    const char *record_path = NULL, *replay_path = NULL, *capture_path = NULL;
+    int fast = 0;
+    uint32_t seed = (uint32_t)time(NULL);
+    int opt;
     int video_fd;
     char video_buffer[VIDEO_BYTES];
-    struct timespec frame_time;
-    frame_time.tv_sec = 0;
-    frame_time.tv_nsec = FRAME_DELAY_NANOSECONDS;
+    pthread_t sim_thread;
+    GameState frame;
+    RaceFrame frame_race;
+    int skip_state = 0;
+    struct timespec stamp, start, end, run_start, last_update;
+    unsigned long sequence = 0, next_sequence;
+    uint64_t stage_start, frame_start;
+
+    while ((opt = getopt_long(argc, argv, "pblr:R:fc:ag:n:", options, NULL)) != -1) {
+        switch (opt) {
+        case 'p':
+            profile = 1;
+            break;
+        case 'b':
+            bench_layers = 1;
+            break;
+        case 'l':
+            lowres = 1;
+            break;
+        case 'r':
+            record_path = optarg;
+            break;
+        case 'R':
+            replay_path = optarg;
+            break;
+        case 'f':
+            fast = 1;
+            break;
+        case 'c':
+            capture_path = optarg;
+            break;
+        case 'a':
+            autopilot = 1;
+            break;
+        case 'g':
+            if (race_add_replay(&race, optarg, TICK_HZ) == -1) {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n':
+            if (race_add_bots(&race, atoi(optarg)) == -1) {
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if ((record_path && replay_path) || (autopilot && replay_path) ||
+        (fast && !replay_path && !autopilot) || (race.count && (record_path || replay_path || fast))) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    profile_init(profile);
+
+    // A replay brings its own seed, a fast one needs nothing else
+    if (race.seeded) {
+        seed = race.seed;
+    }
+    if (replay_path) {
+        if (replay_open_play(&input_log, replay_path, TICK_HZ) == -1) {
+            return EXIT_FAILURE;
+        }
+        if (fast) {
+            return fast_replay();
+        }
+        seed = input_log.header.seed;
+    }
+    if (autopilot && fast) {
+        if (record_path && replay_open_record(&input_log, record_path, seed, TICK_HZ,
+                                              HEADLESS_WIDTH, HEADLESS_HEIGHT) == -1) {
+            return EXIT_FAILURE;
+        }
+        return fast_autopilot(seed);
+    }
     // Initialize audio
     fd = open_physical(fd);
     if (fd == -1){
@@ -429,6 +841,7 @@ int main(int argc, char *argv[]) {
 
     // Register signal handler for SIGINT
     signal(SIGINT, catchSIGINT);
+    signal(SIGUSR1, profile_request_dump);
 
     // Open the video device
     if ((video_fd = open("/dev/video", O_RDWR)) == -1) {
@@ -456,21 +869,155 @@ int main(int argc, char *argv[]) {
      // Clear screen initially
     write(video_fd, "clear\n", 6);
     write(video_fd, "sync\n", 5);
+
+    // Switch before uploading anything, the driver drops sprites when the mode changes
+    if (lowres && write(video_fd, "lowres 1\n", 9) == -1) {
+        perror("Error enabling lowres rendering");
+        lowres = 0;
+    }
  
     
    
-    // Initialize pipes with random positions and heights
-    initialize_pipes();
-    initialize_bird();
+    // Pre-rasterize the bird once, fall back to boxes on drivers without sprites
+    build_bird_sprites();
+    bird_sprites_loaded = (upload_bird_sprites(video_fd) == 0);
+    if (!bird_sprites_loaded) {
+        perror("Error uploading bird sprites, drawing boxes instead");
+    }
+
+    // Text labels need the same sprite store, otherwise use the character buffer
+    labels_loaded = (create_static_labels(video_fd) == 0);
+    if (!labels_loaded) {
+        perror("Error creating text labels, using the character buffer instead");
+    }
+
+    // An empty blend tells whether the driver can draw translucent boxes
+    blend_supported = (send_command(video_fd, "blend 0,0 0,0 0x0000 0\n") != -1);
+    if (!blend_supported) {
+        perror("Error probing alpha blending, drawing without the dim and panels");
+    }
+
+    // Cache the static background in the driver, older drivers clear instead
+    background_saved = (save_background(video_fd) == 0);
+    if (!background_saved) {
+        perror("Error saving the background, clearing each frame instead");
+    }
+
+    // Parallax layers are drawn over the background, skip them on older drivers
+    parallax_layers = parallax_init(video_fd, screen_x, screen_y);
+    if (parallax_layers < PARALLAX_LAYERS) {
+        perror("Error creating parallax layers");
+    }
+    // Drawing has to fit in one tick, the last level halves the frame rate
+    governor_init(&governor, FRAME_DELAY_NANOSECONDS, parallax_layers + 1);
+    if (bench_layers) {
+        parallax_benchmark(video_fd, parallax_layers, BENCHMARK_FRAMES, stdout);
+        write(video_fd, "clear_both\n", 10);
+        unmap_physical(audio_virtual_base, AUDIO_SPAN);
+        close_physical(fd);
+        close(video_fd);
+        close(fd_hex);
+        return 0;
+    }
+
+    if (replay_path && (input_log.header.screen_x != screen_x || input_log.header.screen_y != screen_y)) {
+        fprintf(stderr, "Replay was recorded at %d x %d\n", input_log.header.screen_x, input_log.header.screen_y);
+        return EXIT_FAILURE;
+    }
+    if (record_path && replay_open_record(&input_log, record_path, seed, TICK_HZ,
+                                          screen_x, screen_y) == -1) {
+        return EXIT_FAILURE;
+    }
+
+    // Frames are read back through /dev/mem, the same mapping the audio uses
+    if (capture_path && capture_open(&capture, fd, capture_path, screen_x, screen_y) == -1) {
+        return EXIT_FAILURE;
+    }
+
+    // Build the collision masks and start the first run
+    build_bird_mask();
+    game_init(&game, seed, screen_x, screen_y);
+    if (race.seeded && (race.screen_x != screen_x || race.screen_y != screen_y)) {
+        fprintf(stderr, "Ghosts were recorded at %d x %d\n", race.screen_x, race.screen_y);
+        return EXIT_FAILURE;
+    }
+    race.seed = seed;
+    race_start(&race, &game);
+
+    // Simulation runs on its own thread, this thread renders published states
+    snapshot_init(&snapshot);
+    if (pthread_create(&sim_thread, NULL, simulation_thread, NULL) != 0) {
+        perror("Failed to create simulation thread");
+        close(video_fd);
+        close(fd_hex);
+        return -1;
+    }
 
-    // Animation loop: update and redraw pipes until interrupted
     printf("Starting main loop\n");
+    clock_gettime(CLOCK_MONOTONIC, &run_start);
+    last_update = run_start;
     while (!stop) {
-	//printf("Score: %d\r", score);  // Print score and return to start of line
-	fflush(stdout);  // Ensure score is displayed immediately
-        update_and_draw_pipes(video_fd);  // Update positions and redraw pipes
-	display_on_hex(fd_hex, score);  // Update HEX display with current score
-	nanosleep(&frame_time, NULL);  // Maintain ~60 FPS
+        stage_start = profile_start();
+        next_sequence = snapshot_wait(&snapshot, sequence, &frame, &frame_race, &stamp);
+        profile_stop(PROFILE_WAIT, stage_start);
+        if (next_sequence == 0) {
+            break;  // Simulation thread has stopped
+        }
+        render_stats.skipped += next_sequence - sequence - 1;
+        sequence = next_sequence;
+
+        // At the governor's lowest level every other state is left undrawn
+        if (governor.level > parallax_layers) {
+            skip_state = !skip_state;
+            if (skip_state) {
+                governor.skipped++;
+                continue;
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        frame_start = profile_start();
+        long long work = render_frame(video_fd, &frame, &frame_race);  // Draw pipes and bird, then present
+        stage_start = profile_start();
+        display_on_hex(fd_hex, frame.score);  // Update HEX display with current score
+        profile_stop(PROFILE_HEX, stage_start);
+        profile_stop(PROFILE_FRAME, frame_start);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        long long latency = elapsed_ns(&stamp, &end);
+        render_stats.busy_ns += elapsed_ns(&start, &end);
+        render_stats.latency_ns += latency;
+        if (latency > render_stats.max_latency_ns) {
+            render_stats.max_latency_ns = latency;
+        }
+        render_stats.iterations++;
+        governor_update(&governor, work, elapsed_ns(&last_update, &end));
+        last_update = end;
+
+        // The grab thread copies the presented frame, this thread only notes the swap
+        if (capture.file) {
+            capture_frame(&capture);
+        }
+
+        if (profile_dump_requested) {
+            profile_dump(stdout);
+            profile_dump_requested = 0;
+        }
+    }
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &render_stats.cpu_time);
+    pthread_join(sim_thread, NULL);
+    snapshot_destroy(&snapshot);
+    bot_print_stats("Autopilot", &bot);
+    race_close(&race);
+    capture_close(&capture);
+    if (input_log.file) {
+        if (input_log.recording) {
+            printf("Recorded %lu ticks to %s\n", input_log.tick, record_path);
+        }
+        print_replay_result();
+        if (replay_close(&input_log) == -1) {
+            perror("Error writing the recording");
+        }
     }
 
     // Clear the screen before exiting
@@ -495,6 +1042,9 @@ int main(int argc, char *argv[]) {
         perror("Failed to destroy mutex");
     }
   
+    print_pipeline_stats(&run_start);
+    governor_print_stats(&governor);
+    profile_dump(stdout);
     printf("Program terminated by user.\n");
     return 0;
 }
@@ -0,0 +1,200 @@
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "parallax.h"
+
+#define CLOUD_TILE_WIDTH 64
+#define CLOUD_TILE_HEIGHT 24
+#define CITY_TILE_WIDTH 32
+#define CITY_TILE_HEIGHT 48
+#define GROUND_TILE_WIDTH 16
+#define TILE_MAX_PIXELS (CITY_TILE_WIDTH * CITY_TILE_HEIGHT)  // Largest tile, clouds are the same size
+#define CLOUD_Y 16              // Top of the cloud layer
+#define CLOUD_COLOR 0xFFFF
+#define CITY_COLOR 0x4A8E
+#define WINDOW_COLOR 0xC5EB
+#define GROUND_STRIPE_COLOR 0x6980
+#define LAYER_MAX_TILES 24      // Most tiles the driver takes in one layer
+
+// Sprite ids of the tiles
+enum {
+    TILE_CLOUD_LARGE = PARALLAX_FIRST_TILE,
+    TILE_CLOUD_SMALL,
+    TILE_CITY_TALL,
+    TILE_CITY_LOW,
+    TILE_GROUND
+};
+
+// Tile ids left to right for each layer, and how fast it scrolls
+typedef struct {
+    int rate;
+    int count;
+    int tiles[LAYER_MAX_TILES];
+} LayerSpec;
+
+static const LayerSpec layer_specs[PARALLAX_LAYERS] = {
+    { PARALLAX_RATE_ONE / 4, 5, { TILE_CLOUD_LARGE, TILE_CLOUD_SMALL, TILE_CLOUD_SMALL,
+                                  TILE_CLOUD_LARGE, TILE_CLOUD_SMALL } },
+    { PARALLAX_RATE_ONE / 2, 11, { TILE_CITY_TALL, TILE_CITY_LOW, TILE_CITY_LOW, TILE_CITY_TALL,
+                                   TILE_CITY_LOW, TILE_CITY_TALL, TILE_CITY_TALL, TILE_CITY_LOW,
+                                   TILE_CITY_LOW, TILE_CITY_TALL, TILE_CITY_LOW } },
+    { PARALLAX_RATE_ONE,     1, { TILE_GROUND } },
+};
+
+static unsigned short tiles[5][TILE_MAX_PIXELS];
+static int tile_width[5], tile_height[5];
+static long layer_pixels[PARALLAX_LAYERS];  // Opaque pixels drawn per frame, for the benchmark
+
+static unsigned short *tile_pixel(int id, int x, int y) {
+    return &tiles[id - PARALLAX_FIRST_TILE][y * tile_width[id - PARALLAX_FIRST_TILE] + x];
+}
+
+static void start_tile(int id, int width, int height, unsigned short fill) {
+    tile_width[id - PARALLAX_FIRST_TILE] = width;
+    tile_height[id - PARALLAX_FIRST_TILE] = height;
+    for (int i = 0; i < width * height; i++) {
+        tiles[id - PARALLAX_FIRST_TILE][i] = fill;
+    }
+}
+
+static void tile_circle(int id, int cx, int cy, int r, unsigned short color) {
+    for (int y = cy - r; y <= cy + r; y++) {
+        for (int x = cx - r; x <= cx + r; x++) {
+            if ((x - cx) * (x - cx) + (y - cy) * (y - cy) <= r * r) {
+                *tile_pixel(id, x, y) = color;
+            }
+        }
+    }
+}
+
+// Building from x1 to x2 with its roof at top, lit windows in a regular grid
+static void tile_building(int id, int x1, int x2, int top) {
+    for (int y = top; y < CITY_TILE_HEIGHT; y++) {
+        for (int x = x1; x <= x2; x++) {
+            int window = (x - x1) % 5 == 2 && (y - top) % 6 == 3;
+            *tile_pixel(id, x, y) = window ? WINDOW_COLOR : CITY_COLOR;
+        }
+    }
+}
+
+static void build_tiles(void) {
+    start_tile(TILE_CLOUD_LARGE, CLOUD_TILE_WIDTH, CLOUD_TILE_HEIGHT, PARALLAX_KEY);
+    tile_circle(TILE_CLOUD_LARGE, 18, 14, 8, CLOUD_COLOR);
+    tile_circle(TILE_CLOUD_LARGE, 30, 11, 10, CLOUD_COLOR);
+    tile_circle(TILE_CLOUD_LARGE, 44, 14, 8, CLOUD_COLOR);
+
+    start_tile(TILE_CLOUD_SMALL, CLOUD_TILE_WIDTH, CLOUD_TILE_HEIGHT, PARALLAX_KEY);
+    tile_circle(TILE_CLOUD_SMALL, 24, 16, 5, CLOUD_COLOR);
+    tile_circle(TILE_CLOUD_SMALL, 32, 14, 6, CLOUD_COLOR);
+    tile_circle(TILE_CLOUD_SMALL, 40, 16, 5, CLOUD_COLOR);
+
+    start_tile(TILE_CITY_TALL, CITY_TILE_WIDTH, CITY_TILE_HEIGHT, PARALLAX_KEY);
+    tile_building(TILE_CITY_TALL, 3, 27, 4);
+
+    start_tile(TILE_CITY_LOW, CITY_TILE_WIDTH, CITY_TILE_HEIGHT, PARALLAX_KEY);
+    tile_building(TILE_CITY_LOW, 0, 13, 22);
+    tile_building(TILE_CITY_LOW, 17, 29, 30);
+
+    // Grass on top, diagonal stripes in the dirt make the scrolling visible
+    start_tile(TILE_GROUND, GROUND_TILE_WIDTH, GROUND_HEIGHT, GROUND_COLOR);
+    for (int y = 0; y < GROUND_HEIGHT; y++) {
+        for (int x = 0; x < GROUND_TILE_WIDTH; x++) {
+            if (y < 3) {
+                *tile_pixel(TILE_GROUND, x, y) = GRASS_COLOR;
+            } else if ((x + y) % GROUND_TILE_WIDTH < 3) {
+                *tile_pixel(TILE_GROUND, x, y) = GROUND_STRIPE_COLOR;
+            }
+        }
+    }
+}
+
+// Send one tile to the driver's sprite store in one write
+static int upload_tile(int fd, int id) {
+    char command[64 + sizeof(tiles[0])];
+    int width = tile_width[id - PARALLAX_FIRST_TILE];
+    int height = tile_height[id - PARALLAX_FIRST_TILE];
+    size_t size = width * height * sizeof(unsigned short);
+    int len = snprintf(command, 64, "sprite %d,%d,%d 0x%X\n", id, width, height, PARALLAX_KEY);
+
+    memcpy(command + len, tiles[id - PARALLAX_FIRST_TILE], size);
+    return (write(fd, command, len + size) == -1) ? -1 : 0;
+}
+
+// Opaque pixels one layer puts on a screen_x wide screen, averaged over its period
+static long count_layer_pixels(const LayerSpec *spec, int screen_x) {
+    long opaque = 0;
+    int width = 0;
+
+    for (int t = 0; t < spec->count; t++) {
+        int id = spec->tiles[t];
+        int w = tile_width[id - PARALLAX_FIRST_TILE];
+        for (int i = 0; i < w * tile_height[id - PARALLAX_FIRST_TILE]; i++) {
+            opaque += tiles[id - PARALLAX_FIRST_TILE][i] != PARALLAX_KEY;
+        }
+        width += w;
+    }
+    return opaque * screen_x / width;
+}
+
+int parallax_init(int fd, int screen_x, int screen_y) {
+    char command[128];
+    int y[PARALLAX_LAYERS] = {
+        CLOUD_Y,
+        screen_y - GROUND_HEIGHT - CITY_TILE_HEIGHT,
+        screen_y - GROUND_HEIGHT,
+    };
+
+    build_tiles();
+    for (int id = TILE_CLOUD_LARGE; id <= TILE_GROUND; id++) {
+        if (upload_tile(fd, id) == -1) {
+            return 0;
+        }
+    }
+
+    for (int layer = 0; layer < PARALLAX_LAYERS; layer++) {
+        const LayerSpec *spec = &layer_specs[layer];
+        int len = snprintf(command, sizeof(command), "layer %d,%d,%d",
+                           layer, y[layer], spec->rate);
+
+        for (int t = 0; t < spec->count; t++) {
+            len += snprintf(command + len, sizeof(command) - len, " %d", spec->tiles[t]);
+        }
+        len += snprintf(command + len, sizeof(command) - len, "\n");
+        if (write(fd, command, len) == -1) {
+            return layer;
+        }
+        layer_pixels[layer] = count_layer_pixels(spec, screen_x);
+    }
+    return PARALLAX_LAYERS;
+}
+
+void parallax_benchmark(int fd, int layers, int frames, FILE *out) {
+    char command[64];
+    struct timespec start, end;
+    double base_us = 0;
+    long pixels = 0;
+
+    fprintf(out, "%-7s %10s %10s %12s\n", "layers", "us/frame", "+us/layer", "Mpixel/s");
+    for (int count = 0; count <= layers; count++) {
+        if (count > 0) {
+            pixels += layer_pixels[count - 1];
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int frame = 0; frame < frames; frame++) {
+            write(fd, "restore\n", 8);
+            int len = snprintf(command, sizeof(command), "parallax %llu %d\n",
+                               (unsigned long long)frame * 3 * PARALLAX_RATE_ONE, count);
+            write(fd, command, len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double us = ((end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3) / frames;
+        if (count == 0) {
+            base_us = us;
+        }
+        // Fill rate of the layers alone, restore is the baseline
+        fprintf(out, "%-7d %10.1f %10.1f %12.1f\n", count, us,
+                count ? (us - base_us) / count : 0.0,
+                (count && us > base_us) ? pixels / (us - base_us) : 0.0);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef PARALLAX_H_
+#define PARALLAX_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define PARALLAX_LAYERS 3       // Clouds, city and ground, back to front
+#define PARALLAX_FIRST_TILE 3   // Sprite ids 3 to 7 hold the tiles, between the bird and the labels
+#define PARALLAX_KEY 0xF81F     // Transparent tile pixels
+#define PARALLAX_RATE_ONE 256   // Layer scroll rates are 8.8 fixed point, this moves with the pipes
+#define GROUND_HEIGHT 12        // Ground strip at the bottom of the screen
+#define GROUND_COLOR 0x8A22
+#define GRASS_COLOR 0x2E64
+
+// Upload the tiles and build the driver layers for a screen_x by screen_y
+// screen. Returns the number of layers created, 0 if the driver has no layer support.
+int parallax_init(int fd, int screen_x, int screen_y);
+
+// World scroll position in 1/256 pixels, the unit of the driver's "parallax" command
+static inline uint64_t parallax_scroll(int scroll, float scroll_accumulator) {
+    return (uint64_t)scroll * 256 + (uint64_t)(scroll_accumulator * 256);
+}
+
+// Time restore plus 0 to `layers` layers over `frames` frames each and print
+// the per-frame cost and fill rate of each layer count
+void parallax_benchmark(int fd, int layers, int frames, FILE *out);
+
+#endif
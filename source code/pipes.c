@@ -0,0 +1,87 @@
+#include "pipes.h"
+
+// xorshift32, cheap and identical on every platform so a seed replays exactly
+static uint32_t next_random(PipeStream *stream) {
+    uint32_t x = stream->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    stream->rng = x;
+    return x;
+}
+
+// Generate one pipe at the head of the ring, constrained by the previous height
+static void generate_pipe(PipeStream *stream) {
+    Pipe *pipe = &stream->ring[stream->head & (PIPE_RING_SIZE - 1)];
+    int level = stream->spawned / DIFFICULTY_STEP;
+
+    // Difficulty curve: narrower gaps and tighter spacing every DIFFICULTY_STEP pipes
+    int gap = GAP_SIZE - 2 * level;
+    if (gap < MIN_GAP_SIZE) gap = MIN_GAP_SIZE;
+    int spacing = PIPE_SPACING - 4 * level;
+    if (spacing < MIN_PIPE_SPACING) spacing = MIN_PIPE_SPACING;
+    spacing += next_random(stream) % (PIPE_SPACING_JITTER + 1);
+
+    // Randomize height with a max difference constraint
+    int min_height = stream->previous_height - MAX_PIPE_HEIGHT_DIFF;
+    int max_height = stream->previous_height + MAX_PIPE_HEIGHT_DIFF;
+
+    if (min_height < MIN_PIPE_HEIGHT) min_height = MIN_PIPE_HEIGHT;
+    if (max_height > stream->screen_y - gap) max_height = stream->screen_y - gap;
+    if (max_height < min_height) max_height = min_height;
+
+    pipe->x = stream->next_x;
+    pipe->top_height = min_height + next_random(stream) % (max_height - min_height + 1);
+    pipe->gap = gap;
+    pipe->passed = 0;
+
+    stream->previous_height = pipe->top_height;
+    stream->next_x += PIPE_WIDTH + spacing;
+    stream->spawned++;
+    stream->head++;
+}
+
+// Retire pipes that left the screen, generate ahead and count the on-screen pipes
+static void refresh_stream(PipeStream *stream) {
+    unsigned int i;
+
+    while (stream->tail != stream->head &&
+           pipe_x(stream, &stream->ring[stream->tail & (PIPE_RING_SIZE - 1)]) + PIPE_WIDTH < 0) {
+        stream->tail++;
+    }
+
+    // Keep up to one screen of pipes generated beyond the right edge
+    while (stream->head - stream->tail < PIPE_RING_SIZE &&
+           stream->next_x - stream->scroll < 2 * stream->screen_x) {
+        generate_pipe(stream);
+    }
+
+    for (i = 0; i < stream->head - stream->tail; i++) {
+        if (pipe_x(stream, pipe_stream_get(stream, i)) >= stream->screen_x) {
+            break;
+        }
+    }
+    stream->visible = i;
+}
+
+// Start a new stream with the first pipe just off the right edge of the screen
+void pipe_stream_init(PipeStream *stream, uint32_t seed, int screen_x, int screen_y) {
+    stream->head = 0;
+    stream->tail = 0;
+    stream->visible = 0;
+    stream->spawned = 0;
+    stream->rng = seed ? seed : 1;  // xorshift never leaves zero
+    stream->scroll = 0;
+    stream->next_x = screen_x;
+    stream->screen_x = screen_x;
+    stream->screen_y = screen_y;
+    stream->previous_height = MIN_PIPE_HEIGHT +
+        next_random(stream) % (screen_y - GAP_SIZE - MIN_PIPE_HEIGHT);
+    refresh_stream(stream);
+}
+
+// Scroll the stream left by the given number of pixels
+void pipe_stream_advance(PipeStream *stream, int pixels) {
+    stream->scroll += pixels;
+    refresh_stream(stream);
+}
@@ -0,0 +1,55 @@
+#ifndef PIPES_H_
+#define PIPES_H_
+
+#include <stdint.h>
+
+#define PIPE_WIDTH 20           // Width of each pipe
+#define PIPE_RING_SIZE 16       // Pipes held by the stream, must be a power of two
+#define GAP_SIZE 60             // Space for bird to pass through at the start of a run
+#define MIN_GAP_SIZE 48         // Narrowest gap the difficulty curve reaches
+#define MIN_PIPE_HEIGHT 100     // Minimum height for the top pipe section
+#define MAX_PIPE_HEIGHT_DIFF 40 // Maximum allowed difference in height between pipes
+#define PIPE_SPACING 60         // Space between pipes at the start of a run
+#define MIN_PIPE_SPACING 40     // Tightest spacing the difficulty curve reaches
+#define PIPE_SPACING_JITTER 16  // Random extra spacing added to each pipe
+#define DIFFICULTY_STEP 10      // Pipes generated between difficulty increases
+
+// Structure to represent each pipe's position and dimensions
+typedef struct {
+    int x;          // World X position of the pipe, see pipe_x()
+    int top_height; // Height of the top section of the pipe
+    int gap;        // Height of the opening below the top section
+    int passed;     // Set once the bird has been scored for this pipe
+} Pipe;
+
+// Ring buffer of generated pipes. Pipes are generated ahead of the right edge of
+// the screen and retired once they scroll off the left edge, the first `visible`
+// pipes from the tail are the ones currently on screen.
+typedef struct {
+    Pipe ring[PIPE_RING_SIZE];
+    unsigned int head;      // Slot the next generated pipe goes into
+    unsigned int tail;      // Oldest live pipe
+    unsigned int visible;   // Number of on-screen pipes starting at tail
+    unsigned int spawned;   // Total pipes generated, drives the difficulty curve
+    uint32_t rng;           // Generator state, the stream is fully determined by the seed
+    int scroll;             // Pixels scrolled since the stream started
+    int next_x;             // World X position of the next pipe to generate
+    int previous_height;    // Top height of the last generated pipe
+    int screen_x, screen_y;
+} PipeStream;
+
+// Function prototypes
+void pipe_stream_init(PipeStream *stream, uint32_t seed, int screen_x, int screen_y);
+void pipe_stream_advance(PipeStream *stream, int pixels);
+
+// Get the i-th on-screen pipe, 0 <= i < stream->visible
+static inline Pipe *pipe_stream_get(PipeStream *stream, unsigned int i) {
+    return &stream->ring[(stream->tail + i) & (PIPE_RING_SIZE - 1)];
+}
+
+// Screen X position of a pipe
+static inline int pipe_x(const PipeStream *stream, const Pipe *pipe) {
+    return pipe->x - stream->scroll;
+}
+
+#endif /* PIPES_H_ */
@@ -0,0 +1,145 @@
+#include <time.h>
+#include "profiler.h"
+
+// Fixed-bucket latency histogram for one stage. A stage is only ever written by
+// one thread, dumps from another thread read it without locking.
+typedef struct {
+    const char *name;
+    uint64_t pending_ns;    // Accumulated by profile_add() until profile_commit()
+    unsigned long intervals; // Timed intervals, two clock reads each
+    unsigned long count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    unsigned long buckets[PROFILE_BUCKETS];
+} ProfileStage;
+
+static ProfileStage stages[PROFILE_STAGES] = {
+    [PROFILE_INPUT]   = { .name = "input" },
+    [PROFILE_UPDATE]  = { .name = "update" },
+    [PROFILE_PUBLISH] = { .name = "publish" },
+    [PROFILE_SLEEP]   = { .name = "sleep" },
+    [PROFILE_WAIT]    = { .name = "wait" },
+    [PROFILE_CLEAR]   = { .name = "clear" },
+    [PROFILE_FORMAT]  = { .name = "format" },
+    [PROFILE_DRAW]    = { .name = "draw" },
+    [PROFILE_SYNC]    = { .name = "sync" },
+    [PROFILE_SWAP]    = { .name = "swap" },
+    [PROFILE_HEX]     = { .name = "hex" },
+    [PROFILE_FRAME]   = { .name = "frame" },
+};
+
+static int profile_enabled = 0;
+static uint64_t clock_cost_ns = 0;          // Measured cost of one clock read
+static uint64_t enabled_at_ns = 0;
+volatile sig_atomic_t profile_dump_requested = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Enable or disable timing, and calibrate the cost of a clock read so the dump
+// can report the profiler's own overhead
+void profile_init(int enabled) {
+    uint64_t start;
+    int i;
+
+    profile_enabled = enabled;
+    if (!enabled) {
+        return;
+    }
+    start = now_ns();
+    for (i = 0; i < 1000; i++) {
+        now_ns();
+    }
+    clock_cost_ns = (now_ns() - start) / 1000;
+    enabled_at_ns = now_ns();
+}
+
+// Timestamp for a later profile_add() or profile_stop(), 0 when disabled
+uint64_t profile_start(void) {
+    if (!profile_enabled) {
+        return 0;
+    }
+    return now_ns();
+}
+
+// Add the time since start to the stage's sample for this tick or frame
+void profile_add(int stage, uint64_t start) {
+    if (!profile_enabled) {
+        return;
+    }
+    stages[stage].intervals++;
+    stages[stage].pending_ns += now_ns() - start;
+}
+
+// Record the accumulated sample into the stage's histogram
+void profile_commit(int stage) {
+    ProfileStage *entry = &stages[stage];
+    uint64_t us;
+    int bucket = 0;
+
+    if (!profile_enabled) {
+        return;
+    }
+    us = entry->pending_ns / 1000;
+    while (us > 0 && bucket < PROFILE_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    entry->buckets[bucket]++;
+    entry->count++;
+    entry->total_ns += entry->pending_ns;
+    if (entry->pending_ns > entry->max_ns) {
+        entry->max_ns = entry->pending_ns;
+    }
+    entry->pending_ns = 0;
+}
+
+// Time a stage that runs once per tick or frame
+void profile_stop(int stage, uint64_t start) {
+    profile_add(stage, start);
+    profile_commit(stage);
+}
+
+void profile_dump(FILE *out) {
+    uint64_t wall_ns;
+    unsigned long intervals = 0;
+    int i, b;
+
+    if (!profile_enabled) {
+        return;
+    }
+    wall_ns = now_ns() - enabled_at_ns;
+    fprintf(out, "%-8s %8s %10s %10s  histogram (from us: count)\n", "stage", "count", "avg us", "max us");
+    for (i = 0; i < PROFILE_STAGES; i++) {
+        ProfileStage *entry = &stages[i];
+        intervals += entry->intervals;
+        if (entry->count == 0) {
+            continue;
+        }
+        fprintf(out, "%-8s %8lu %10.1f %10.1f ", entry->name, entry->count,
+                entry->total_ns / 1000.0 / entry->count, entry->max_ns / 1000.0);
+        for (b = 0; b < PROFILE_BUCKETS; b++) {
+            if (entry->buckets[b] == 0) {
+                continue;
+            }
+            if (b == 0) {
+                fprintf(out, " <1:%lu", entry->buckets[b]);
+            } else {
+                fprintf(out, " %u:%lu", 1u << (b - 1), entry->buckets[b]);
+            }
+        }
+        fprintf(out, "\n");
+    }
+    if (wall_ns > 0) {
+        fprintf(out, "profiler overhead: %.3f%% of wall time\n",
+                100.0 * 2 * intervals * clock_cost_ns / wall_ns);
+    }
+}
+
+// SIGUSR1 handler, the render loop prints the dump at the end of its frame
+void profile_request_dump(int signum) {
+    profile_dump_requested = 1;
+}
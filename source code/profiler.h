@@ -0,0 +1,38 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+
+#define PROFILE_BUCKETS 18    // Power-of-two microsecond buckets, the last one open ended
+
+// Stages timed every tick (simulation thread) or frame (render thread)
+enum {
+    PROFILE_INPUT,      // read_key_input()
+    PROFILE_UPDATE,     // game_step()
+    PROFILE_PUBLISH,    // snapshot_publish()
+    PROFILE_SLEEP,      // Sleeping until the next tick
+    PROFILE_WAIT,       // Render thread waiting for a new state
+    PROFILE_CLEAR,      // "clear" write, driver memset of the back buffer
+    PROFILE_FORMAT,     // Formatting draw commands
+    PROFILE_DRAW,       // Draw command writes, driver parsing and rasterization
+    PROFILE_SYNC,       // "sync" writes, driver waiting on the VGA controller
+    PROFILE_SWAP,       // "swap" write, driver buffer flip
+    PROFILE_HEX,        // HEX display update
+    PROFILE_FRAME,      // Whole render frame including the HEX update
+    PROFILE_STAGES
+};
+
+extern volatile sig_atomic_t profile_dump_requested;
+
+// Function prototypes
+void profile_init(int enabled);
+uint64_t profile_start(void);
+void profile_add(int stage, uint64_t start);
+void profile_commit(int stage);
+void profile_stop(int stage, uint64_t start);
+void profile_dump(FILE *out);
+void profile_request_dump(int signum);
+
+#endif /* PROFILER_H_ */
@@ -0,0 +1,123 @@
+#include <string.h>
+#include "race.h"
+
+// Race against the first run of a recorded session. All recorded ghosts must
+// come from the same seed and screen, the race takes both from the first one.
+int race_add_replay(Race *race, const char *path, int tick_hz) {
+    Ghost *ghost;
+
+    if (race->count == MAX_GHOSTS) {
+        fprintf(stderr, "At most %d ghosts\n", MAX_GHOSTS);
+        return -1;
+    }
+    ghost = &race->ghosts[race->count];
+    memset(ghost, 0, sizeof(*ghost));
+    if (replay_open_play(&ghost->log, path, tick_hz) == -1) {
+        return -1;
+    }
+    if (!race->seeded) {
+        race->seed = ghost->log.header.seed;
+        race->screen_x = ghost->log.header.screen_x;
+        race->screen_y = ghost->log.header.screen_y;
+        race->seeded = 1;
+    } else if (ghost->log.header.seed != race->seed || ghost->log.header.screen_x != race->screen_x ||
+               ghost->log.header.screen_y != race->screen_y) {
+        fprintf(stderr, "%s was recorded on a different course than the other ghosts\n", path);
+        replay_close(&ghost->log);
+        return -1;
+    }
+    race->count++;
+    return 0;
+}
+
+// Add bots spread evenly over the aim range so they fly apart
+int race_add_bots(Race *race, int count) {
+    if (count < 1 || race->count + count > MAX_GHOSTS) {
+        fprintf(stderr, "Between 1 and %d ghosts\n", MAX_GHOSTS);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        Ghost *ghost = &race->ghosts[race->count++];
+
+        memset(ghost, 0, sizeof(*ghost));
+        ghost->bot.aim = (count > 1) ? -GHOST_AIM_SPREAD + 2 * GHOST_AIM_SPREAD * i / (count - 1) : 0;
+    }
+    return 0;
+}
+
+// Line every ghost up on the player's freshly started run
+void race_start(Race *race, const GameState *game) {
+    for (int i = 0; i < race->count; i++) {
+        Ghost *ghost = &race->ghosts[i];
+
+        ghost->state = *game;
+        if (ghost->log.file && replay_rewind(&ghost->log) == -1) {
+            ghost->state.game_over = 1;
+        }
+    }
+}
+
+// Advance the ghosts still flying by one tick and list where they are. The
+// bot ghosts split budget game_step() calls evenly, so the tick costs the
+// same however many of them fly.
+void race_step(Race *race, RaceFrame *frame, int budget) {
+    int bots = 0;
+
+    for (int i = 0; i < race->count; i++) {
+        bots += !race->ghosts[i].state.game_over && !race->ghosts[i].log.file;
+    }
+    if (bots > 0) {
+        budget /= bots;
+        if (budget > GHOST_BOT_BUDGET) {
+            budget = GHOST_BOT_BUDGET;
+        } else if (budget < 2) {
+            budget = 2;  // One flap and one fall, 0 would mean BOT_NODE_BUDGET
+        }
+    }
+
+    frame->count = 0;
+    for (int i = 0; i < race->count; i++) {
+        Ghost *ghost = &race->ghosts[i];
+        int keys;
+
+        if (ghost->state.game_over) {
+            continue;
+        }
+        if (ghost->log.file) {
+            keys = replay_next(&ghost->log);
+            if (keys < 0) {
+                ghost->state.game_over = 1;  // The recording ended before the bird crashed
+                continue;
+            }
+        } else {
+            ghost->bot.budget = budget;
+            keys = bot_decide(&ghost->bot, &ghost->state);
+        }
+        game_step(&ghost->state, keys);
+        if (!ghost->state.game_over) {
+            frame->y[frame->count++] = ghost->state.bird.y;
+        }
+    }
+}
+
+// Close the recordings and report what the bot ghosts cost per tick
+void race_close(Race *race) {
+    Bot total;
+
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < race->count; i++) {
+        Ghost *ghost = &race->ghosts[i];
+
+        if (ghost->log.file) {
+            replay_close(&ghost->log);
+        } else {
+            total.decisions += ghost->bot.decisions;
+            total.nodes += ghost->bot.nodes;
+            total.budget_hits += ghost->bot.budget_hits;
+            total.busy_ns += ghost->bot.busy_ns;
+        }
+    }
+    if (total.decisions > 0) {
+        bot_print_stats("Ghost bots", &total);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef RACE_H_
+#define RACE_H_
+
+#include <stdint.h>
+#include "game.h"
+#include "replay.h"
+#include "bot.h"
+
+#define MAX_GHOSTS 31           // With the player, one driver "instances" batch of 32
+#define GHOST_BOT_BUDGET 200    // Most game_step() calls per decision of each bot ghost
+#define GHOST_AIM_SPREAD 12     // Bot ghosts aim up to this many pixels off the middle of a gap
+
+// A bird racing the player over the same pipes. It steps its own copy of the
+// game, started with the player's, using the keys of a recorded run or a bot's,
+// and drops out at its first crash.
+typedef struct {
+    GameState state;
+    Replay log;                 // Recorded run, if log.file is set
+    Bot bot;                    // Otherwise the autopilot flies
+} Ghost;
+
+// Ghosts and the seed every run of the race starts from, so the player always
+// meets the pipes the ghosts were recorded or are flying on
+typedef struct {
+    Ghost ghosts[MAX_GHOSTS];
+    int count;
+    uint32_t seed;
+    int seeded;                 // seed comes from the first recorded ghost
+    int screen_x, screen_y;
+} Race;
+
+// Ghosts still flying after one tick, published to the render thread with the game
+typedef struct {
+    int count;
+    int y[MAX_GHOSTS];          // Every ghost shares the player's bird.x
+} RaceFrame;
+
+// Function prototypes
+int race_add_replay(Race *race, const char *path, int tick_hz);
+int race_add_bots(Race *race, int count);
+void race_start(Race *race, const GameState *game);
+void race_step(Race *race, RaceFrame *frame, int budget);
+void race_close(Race *race);
+
+#endif /* RACE_H_ */
@@ -0,0 +1,729 @@
+#ifndef RASTER_H_
+#define RASTER_H_
+
+// Freestanding RGB565 rasterizer shared by the video driver and host tools.
+// Everything here works on a struct surface describing plain memory, with no
+// driver state, so the same code draws into the VGA back buffer in the module
+// and into a malloc'd buffer in raster_bench.c. Header only, so the module
+// stays a single translation unit.
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#include <linux/atomic.h>
+#include <asm/io.h>
+
+#define raster_warn(fmt, ...) printk_ratelimited(KERN_ERR fmt, ##__VA_ARGS__)
+#else
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint64_t u64;
+typedef int64_t s64;
+
+// Host tools draw from one thread, plain counters stand in for the atomics
+typedef struct { long long counter; } atomic64_t;
+static inline void atomic64_add(long long i, atomic64_t *v) { v->counter += i; }
+static inline void atomic64_inc(atomic64_t *v) { v->counter++; }
+static inline long long atomic64_read(const atomic64_t *v) { return v->counter; }
+
+// Plain memory stands in for the pixel buffers. The copies stay calls as on
+// the board: inlined into a kernel that bounds the length, the compiler would
+// turn them into string instructions slower than the library routines for
+// sprite-sized runs, and time the specialized kernels against the wrong code.
+#ifndef __always_inline
+#define __always_inline inline __attribute__((always_inline))
+#endif
+static __attribute__((noipa)) void memset_io(volatile void *dst, int c, size_t n) {
+    memset((void *)dst, c, n);
+}
+static __attribute__((noipa)) void memcpy_toio(volatile void *dst, const void *src, size_t n) {
+    memcpy((void *)dst, src, n);
+}
+#define div64_s64(a, b) ((a) / (b))
+#define div64_u64_rem(a, b, rem) (*(rem) = (a) % (b), (a) / (b))
+#define raster_warn(fmt, ...) do { } while (0)
+#endif
+
+#include "font5x7.h"
+
+#define ROW_BYTES 0x400         // Pixel buffer row stride
+#define VGA_WIDTH 320           // DE1-SoC VGA layout the raster kernels are specialized for
+#define VGA_HEIGHT 240
+
+// Blend weights run from 0, which keeps the surface, to ALPHA_ONE, which replaces it
+#define ALPHA_ONE 32
+
+// Channel lanes of two RGB565 pixels packed in one 32-bit word, low pixel first
+#define BLEND_EVEN 0x07E0F81F   // Blue and red of the low pixel, green of the high one
+#define BLEND_ODD 0xF81F07E0    // Green of the low pixel, blue and red of the high one
+
+// Cohen-Sutherland outcodes for line clipping
+#define CLIP_LEFT 0x1
+#define CLIP_RIGHT 0x2
+#define CLIP_TOP 0x4
+#define CLIP_BOTTOM 0x8
+#define CLIP_PASSES 4           // Two edges for each end
+#define SHORT_RUN 4             // Line runs shorter than this skip fill_span()
+
+// Run of opaque pixels within one sprite row
+struct sprite_span {
+    short row;
+    short x;
+    short length;
+};
+
+// Pixels stored and dropped by everything that draws, clears included. Atomic
+// since every client of the driver draws concurrently into the same counters.
+struct raster_stats {
+    atomic64_t pixels_filled;
+    atomic64_t out_of_bounds;
+};
+
+// Pixels the drawing commands render into
+struct surface {
+    volatile void *pixels;  // Pixel (0, 0)
+    int stride;             // Bytes from one row to the next
+    int width, height;
+    struct raster_stats *stats;  // Counters drawing into this surface adds to
+};
+
+// Fill, blit, blend and clear kernels for one surface geometry, see specialized_raster()
+struct raster_ops {
+    const char *name;
+    void (*clear)(const struct surface *surface);
+    void (*fill)(const struct surface *surface, int x1, int y1, int x2, int y2, unsigned short color);
+    void (*blit)(const struct surface *surface, const unsigned short *pixels, int width,
+                 const struct sprite_span *spans, int count, int x, int y);
+    void (*blend)(const struct surface *surface, int x1, int y1, int x2, int y2, unsigned short color,
+                  int alpha);
+    void (*blend_blit)(const struct surface *surface, const unsigned short *pixels, int width,
+                       const struct sprite_span *spans, int count, int x, int y, int alpha);
+};
+
+static inline void plot_pixel(const struct surface *surface, int x, int y, short int color) {
+    volatile short int *pixel_addr;
+
+    if (x < 0 || x >= surface->width || y < 0 || y >= surface->height) {
+        atomic64_inc(&surface->stats->out_of_bounds);
+        raster_warn("Error: pixel coordinates out of bounds (%d, %d)\n", x, y);
+        return;
+    }
+
+    pixel_addr = (volatile short int *)(surface->pixels + (y * surface->stride) + (x * 2));
+    *pixel_addr = color;
+    atomic64_inc(&surface->stats->pixels_filled);
+}
+
+// Store len pixels starting at p, two per 32-bit write once p is word aligned
+static inline void fill_span(volatile unsigned short *p, int len, unsigned short color) {
+    volatile unsigned int *wide;
+    unsigned int pair = color | ((unsigned int)color << 16);
+
+    if (len > 0 && ((unsigned long)p & 2)) {
+        *p++ = color;
+        len--;
+    }
+    wide = (volatile unsigned int *)p;
+    for (; len >= 2; len -= 2)
+        *wide++ = pair;
+    if (len)
+        *(volatile unsigned short *)wide = color;
+}
+
+// Store len pixels going down the screen starting at p, row pixels apart
+static inline void fill_column(volatile unsigned short *p, int len, int row, unsigned short color) {
+    for (; len > 0; len--, p += row)
+        *p = color;
+}
+
+// Blend two pixels at once. Each lane mask keeps three channels with at least
+// five clear bits above each of them, so one multiply by a weight up to
+// ALPHA_ONE scales all three without carrying into the next. even and odd are
+// the source lanes already multiplied by its weight, keep is the weight left
+// for dst. The odd lanes are shifted down to make room and land back in place
+// when the low five bits of the product are masked off.
+static inline unsigned int blend_pair(unsigned int dst, unsigned int even, unsigned int odd, int keep) {
+    unsigned int low = (((dst & BLEND_EVEN) * keep + even) >> 5) & BLEND_EVEN;
+    unsigned int high = (((dst >> 5) & (BLEND_ODD >> 5)) * keep + odd) & BLEND_ODD;
+
+    return low | high;
+}
+
+// Blend len pixels starting at p toward color, a word per pixel pair once p is aligned
+static inline void blend_span(volatile unsigned short *p, int len, unsigned short color, int alpha) {
+    unsigned int pair = color | ((unsigned int)color << 16);
+    unsigned int even = (pair & BLEND_EVEN) * alpha;
+    unsigned int odd = ((pair >> 5) & (BLEND_ODD >> 5)) * alpha;
+    int keep = ALPHA_ONE - alpha;
+    volatile unsigned int *wide;
+
+    if (len > 0 && ((unsigned long)p & 2)) {
+        *p = blend_pair(*p, even, odd, keep);
+        p++;
+        len--;
+    }
+    wide = (volatile unsigned int *)p;
+    for (; len >= 2; len -= 2, wide++)
+        *wide = blend_pair(*wide, even, odd, keep);
+    if (len)
+        *(volatile unsigned short *)wide = blend_pair(*(volatile unsigned short *)wide, even, odd, keep);
+}
+
+// Blend len source pixels over the pixels starting at p, a word per pixel pair
+static inline void blend_copy(volatile unsigned short *p, const unsigned short *src, int len, int alpha) {
+    int keep = ALPHA_ONE - alpha;
+    volatile unsigned int *wide;
+    unsigned int pair;
+
+    if (len > 0 && ((unsigned long)p & 2)) {
+        pair = *src++;
+        *p = blend_pair(*p, (pair & BLEND_EVEN) * alpha, ((pair >> 5) & (BLEND_ODD >> 5)) * alpha, keep);
+        p++;
+        len--;
+    }
+    wide = (volatile unsigned int *)p;
+    for (; len >= 2; len -= 2, wide++, src += 2) {
+        pair = src[0] | ((unsigned int)src[1] << 16);
+        *wide = blend_pair(*wide, (pair & BLEND_EVEN) * alpha, ((pair >> 5) & (BLEND_ODD >> 5)) * alpha, keep);
+    }
+    if (len) {
+        pair = *src;
+        *(volatile unsigned short *)wide = blend_pair(*(volatile unsigned short *)wide, (pair & BLEND_EVEN) * alpha,
+                                                      ((pair >> 5) & (BLEND_ODD >> 5)) * alpha, keep);
+    }
+}
+
+static inline int clip_outcode(const struct surface *surface, int x, int y) {
+    int code = 0;
+
+    if (x < 0)
+        code |= CLIP_LEFT;
+    else if (x >= surface->width)
+        code |= CLIP_RIGHT;
+    if (y < 0)
+        code |= CLIP_TOP;
+    else if (y >= surface->height)
+        code |= CLIP_BOTTOM;
+    return code;
+}
+
+// Clip a line to the surface with Cohen-Sutherland, returns 0 if none of it is visible.
+// Differences are taken in 64 bits, so any int endpoints clip without wrapping
+// as long as the line spans less than 2^31 in x or in y. Each pass moves one
+// end onto one edge, so no visible line needs more than CLIP_PASSES of them.
+static inline int clip_line(const struct surface *surface, int *x0, int *y0, int *x1, int *y1) {
+    int code0 = clip_outcode(surface, *x0, *y0);
+    int code1 = clip_outcode(surface, *x1, *y1);
+    int pass;
+
+    for (pass = 0; code0 | code1; pass++) {
+        int code, x, y;
+        s64 dx = (s64)*x1 - *x0, dy = (s64)*y1 - *y0;
+
+        if ((code0 & code1) || pass == CLIP_PASSES)
+            return 0;  // Both ends on the same outside side
+
+        code = code0 ? code0 : code1;
+        if (code & CLIP_TOP) {
+            y = 0;
+            x = *x0 + div64_s64(dx * ((s64)y - *y0), dy);
+        } else if (code & CLIP_BOTTOM) {
+            y = surface->height - 1;
+            x = *x0 + div64_s64(dx * ((s64)y - *y0), dy);
+        } else if (code & CLIP_LEFT) {
+            x = 0;
+            y = *y0 + div64_s64(dy * ((s64)x - *x0), dx);
+        } else {
+            x = surface->width - 1;
+            y = *y0 + div64_s64(dy * ((s64)x - *x0), dx);
+        }
+
+        if (code == code0) {
+            *x0 = x;
+            *y0 = y;
+            code0 = clip_outcode(surface, x, y);
+        } else {
+            *x1 = x;
+            *y1 = y;
+            code1 = clip_outcode(surface, x, y);
+        }
+    }
+    return 1;
+}
+
+// Draw the part of a line crossing the surface edge, a pixel per step from
+// the first column (or row, for steep lines) on the surface. The Bresenham
+// state there is worked out from the original endpoints, so the pixels drawn
+// are exactly those of the whole line that land on the surface. Redrawing
+// between clipped endpoints would round them and bend the line.
+static inline void draw_clipped_line(const struct surface *surface, int x0, int y0, int x1, int y1,
+                                     short int color) {
+    s64 dx = (s64)x1 - x0, dy = (s64)y1 - y0;
+    int steep = (dy < 0 ? -dy : dy) > (dx < 0 ? -dx : dx);
+    s64 major0 = steep ? y0 : x0, minor0 = steep ? x0 : y0;
+    s64 major1 = steep ? y1 : x1, minor1 = steep ? x1 : y1;
+    s64 major_limit = steep ? surface->height : surface->width;
+    s64 minor_limit = steep ? surface->width : surface->height;
+    s64 first, last, k, minor, error, delta, temp;
+    u64 steps, rise, half, n, rem;
+    int minor_step, filled = 0;
+
+    if (major0 > major1) {
+        temp = major0; major0 = major1; major1 = temp;
+        temp = minor0; minor0 = minor1; minor1 = temp;
+    }
+    steps = major1 - major0;
+    rise = (minor1 > minor0) ? minor1 - minor0 : minor0 - minor1;
+    minor_step = (minor0 < minor1) ? 1 : -1;
+    half = steps / 2;
+
+    first = (major0 < 0) ? -major0 : 0;
+    last = (major1 >= major_limit) ? major_limit - 1 - major0 : (s64)steps;
+    if (first > last)
+        return;
+
+    // After k steps the error, starting at -half and gaining rise per step,
+    // has lost steps once for every minor step taken
+    if (steps < 2) {
+        n = first * rise;
+        error = (s64)(first * rise) - (s64)half - (s64)(n * steps);
+    } else if (first * rise < half) {
+        n = 0;
+        error = (s64)(first * rise) - (s64)half;
+    } else {
+        n = div64_u64_rem(first * rise - half, steps, &rem) + 1;
+        error = (s64)rem - (s64)steps;
+    }
+    minor = minor0 + minor_step * (s64)n;
+    delta = rise;
+
+    for (k = first; k <= last; k++) {
+        if (minor >= 0 && minor < minor_limit) {
+            s64 x = steep ? minor : major0 + k, y = steep ? major0 + k : minor;
+
+            *(volatile unsigned short *)(surface->pixels + y * surface->stride + x * 2) = color;
+            filled++;
+        }
+        error += delta;
+        if (error >= 0) {
+            minor += minor_step;
+            error -= steps;
+        }
+    }
+    atomic64_add(filled, &surface->stats->pixels_filled);
+}
+
+// Draw a line between (x0, y0) and (x1, y1). A line inside the surface is
+// drawn as horizontal or vertical runs (run-length slice Bresenham) written
+// straight into the surface with no per-pixel bounds checks.
+static inline void draw_line(const struct surface *surface, int x0, int y0, int x1, int y1, short int color) {
+    volatile unsigned short *p;
+    int temp, dx, dy, x_advance, whole_step, adjust_up, adjust_down, error;
+    int initial_count, final_count, run, i;
+    int row = surface->stride / 2;
+    int cx0 = x0, cy0 = y0, cx1 = x1, cy1 = y1;
+
+    if (!clip_line(surface, &cx0, &cy0, &cx1, &cy1))
+        return;
+    if (cx0 != x0 || cy0 != y0 || cx1 != x1 || cy1 != y1) {
+        draw_clipped_line(surface, x0, y0, x1, y1, color);
+        return;
+    }
+
+    // Always draw top to bottom
+    if (y0 > y1) {
+        temp = x0; x0 = x1; x1 = temp;
+        temp = y0; y0 = y1; y1 = temp;
+    }
+    dx = x1 - x0;
+    dy = y1 - y0;
+    x_advance = (dx < 0) ? -1 : 1;
+    dx = abs(dx);
+    p = (volatile unsigned short *)(surface->pixels + (y0 * surface->stride) + (x0 * 2));
+
+    // Horizontal and vertical lines are single spans
+    if (dy == 0) {
+        fill_span(p - ((x_advance < 0) ? dx : 0), dx + 1, color);
+        atomic64_add(dx + 1, &surface->stats->pixels_filled);
+        return;
+    }
+    if (dx == 0) {
+        fill_column(p, dy + 1, row, color);
+        atomic64_add(dy + 1, &surface->stats->pixels_filled);
+        return;
+    }
+    atomic64_add(((dx > dy) ? dx : dy) + 1, &surface->stats->pixels_filled);
+
+    if (dx >= dy) {
+        // Shallow line: dy + 1 horizontal runs, the first and last split a whole step
+        whole_step = dx / dy;
+        adjust_up = (dx % dy) * 2;
+        adjust_down = dy * 2;
+        error = (dx % dy) - dy * 2;
+        initial_count = whole_step / 2 + 1;
+        final_count = initial_count;
+        if (adjust_up == 0 && (whole_step & 1) == 0)
+            initial_count--;
+        if (whole_step & 1)
+            error += dy;
+
+        for (i = 0; i <= dy; i++) {
+            if (i == 0) {
+                run = initial_count;
+            } else if (i == dy) {
+                run = final_count;
+            } else {
+                run = whole_step;
+                if ((error += adjust_up) > 0) {
+                    run++;
+                    error -= adjust_down;
+                }
+            }
+            if (whole_step < SHORT_RUN) {
+                // Near 45 degrees runs are a pixel or two, cheaper stored one at a time
+                for (; run > 0; run--, p += x_advance)
+                    *p = color;
+                p += row;
+            } else if (x_advance > 0) {
+                fill_span(p, run, color);
+                p += run + row;
+            } else {
+                fill_span(p - run + 1, run, color);
+                p += row - run;
+            }
+        }
+    } else {
+        // Steep line: dx + 1 vertical runs
+        whole_step = dy / dx;
+        adjust_up = (dy % dx) * 2;
+        adjust_down = dx * 2;
+        error = (dy % dx) - dx * 2;
+        initial_count = whole_step / 2 + 1;
+        final_count = initial_count;
+        if (adjust_up == 0 && (whole_step & 1) == 0)
+            initial_count--;
+        if (whole_step & 1)
+            error += dx;
+
+        for (i = 0; i <= dx; i++) {
+            if (i == 0) {
+                run = initial_count;
+            } else if (i == dx) {
+                run = final_count;
+            } else {
+                run = whole_step;
+                if ((error += adjust_up) > 0) {
+                    run++;
+                    error -= adjust_down;
+                }
+            }
+            fill_column(p, run, row, color);
+            p += run * row + x_advance;
+        }
+    }
+}
+
+// Raster kernels. Each takes the surface geometry as arguments and is always
+// inlined, so the fill and blend instances below for fixed layouts get the
+// stride and bounds as constants while generic_ops reads them from the surface
+// at run time.
+
+// Clear the visible part of every row, in one store when rows are contiguous
+static __always_inline void clear_kernel(struct raster_stats *stats, volatile void *base,
+                                         int stride, int width, int height) {
+    int y;
+
+    atomic64_add(width * height, &stats->pixels_filled);
+    if (stride == width * 2) {
+        memset_io((void *)base, 0, height * stride);
+        return;
+    }
+    for (y = 0; y < height; y++)
+        memset_io((void *)(base + y * stride), 0, width * 2);
+}
+
+// Fill an inclusive rectangle clipped to the surface, dropped pixels are counted
+static __always_inline void fill_kernel(struct raster_stats *stats, volatile void *base,
+                                        int stride, int width, int height,
+                                        int x1, int y1, int x2, int y2, unsigned short color) {
+    u64 area;
+    int y;
+
+    if (x2 < x1 || y2 < y1)
+        return;
+    area = (u64)(x2 - x1 + 1) * (y2 - y1 + 1);
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= width) x2 = width - 1;
+    if (y2 >= height) y2 = height - 1;
+    if (x2 < x1 || y2 < y1) {
+        atomic64_add(area, &stats->out_of_bounds);
+        return;
+    }
+    atomic64_add(area - (u64)(x2 - x1 + 1) * (y2 - y1 + 1), &stats->out_of_bounds);
+    atomic64_add((x2 - x1 + 1) * (y2 - y1 + 1), &stats->pixels_filled);
+
+    for (y = y1; y <= y2; y++)
+        fill_span((volatile unsigned short *)(base + y * stride + x1 * 2), x2 - x1 + 1, color);
+}
+
+// Copy opaque runs of a width pixel wide image with its top-left corner at
+// (x, y), one row copy per run, clipped to the surface
+static __always_inline void blit_kernel(struct raster_stats *stats, volatile void *base,
+                                        int stride, int width, int height,
+                                        const unsigned short *pixels, int pixels_width,
+                                        const struct sprite_span *spans, int count, int x, int y) {
+    int i, filled = 0;
+
+    for (i = 0; i < count; i++) {
+        const struct sprite_span *span = &spans[i];
+        int py = y + span->row;
+        int start = x + span->x;
+        int end = start + span->length;
+        int skip = 0;
+
+        if (py < 0 || py >= height)
+            continue;
+        if (start < 0) {
+            skip = -start;
+            start = 0;
+        }
+        if (end > width)
+            end = width;
+        if (end <= start)
+            continue;
+
+        memcpy_toio((void *)(base + (py * stride) + (start * 2)),
+                    pixels + span->row * pixels_width + span->x + skip,
+                    (end - start) * 2);
+        filled += end - start;
+    }
+    atomic64_add(filled, &stats->pixels_filled);
+}
+
+// Blend an inclusive rectangle clipped to the surface toward color by alpha.
+// Fully opaque blends are plain fills.
+static __always_inline void blend_kernel(struct raster_stats *stats, volatile void *base,
+                                         int stride, int width, int height,
+                                         int x1, int y1, int x2, int y2, unsigned short color, int alpha) {
+    int y;
+
+    if (alpha <= 0)
+        return;
+    if (alpha >= ALPHA_ONE) {
+        fill_kernel(stats, base, stride, width, height, x1, y1, x2, y2, color);
+        return;
+    }
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= width) x2 = width - 1;
+    if (y2 >= height) y2 = height - 1;
+    if (x2 < x1 || y2 < y1)
+        return;
+    atomic64_add((x2 - x1 + 1) * (y2 - y1 + 1), &stats->pixels_filled);
+
+    for (y = y1; y <= y2; y++)
+        blend_span((volatile unsigned short *)(base + y * stride + x1 * 2), x2 - x1 + 1, color, alpha);
+}
+
+// blit_kernel() with every opaque run blended over the surface by alpha
+static __always_inline void blend_blit_kernel(struct raster_stats *stats, volatile void *base,
+                                              int stride, int width, int height,
+                                              const unsigned short *pixels, int pixels_width,
+                                              const struct sprite_span *spans, int count, int x, int y,
+                                              int alpha) {
+    int i, filled = 0;
+
+    if (alpha <= 0)
+        return;
+    if (alpha >= ALPHA_ONE) {
+        blit_kernel(stats, base, stride, width, height, pixels, pixels_width, spans, count, x, y);
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        const struct sprite_span *span = &spans[i];
+        int py = y + span->row;
+        int start = x + span->x;
+        int end = start + span->length;
+        int skip = 0;
+
+        if (py < 0 || py >= height)
+            continue;
+        if (start < 0) {
+            skip = -start;
+            start = 0;
+        }
+        if (end > width)
+            end = width;
+        if (end <= start)
+            continue;
+
+        blend_copy((volatile unsigned short *)(base + (py * stride) + (start * 2)),
+                   pixels + span->row * pixels_width + span->x + skip, end - start, alpha);
+        filled += end - start;
+    }
+    atomic64_add(filled, &stats->pixels_filled);
+}
+
+// A clear or a sprite row is one library copy whatever the geometry, so a
+// fixed stride saves nothing there and every kernel set shares these
+static void generic_clear(const struct surface *surface) {
+    clear_kernel(surface->stats, surface->pixels, surface->stride, surface->width, surface->height);
+}
+
+static void generic_blit(const struct surface *surface, const unsigned short *pixels, int pixels_width,
+                         const struct sprite_span *spans, int count, int x, int y) {
+    blit_kernel(surface->stats, surface->pixels, surface->stride, surface->width, surface->height,
+                pixels, pixels_width, spans, count, x, y);
+}
+
+static void generic_blend_blit(const struct surface *surface, const unsigned short *pixels, int pixels_width,
+                               const struct sprite_span *spans, int count, int x, int y, int alpha) {
+    blend_blit_kernel(surface->stats, surface->pixels, surface->stride, surface->width, surface->height,
+                      pixels, pixels_width, spans, count, x, y, alpha);
+}
+
+// Instantiate the rectangle kernels for one surface geometry, the geometry
+// expressions may refer to the surface argument
+#define DEFINE_RASTER_OPS(prefix, label, stride, width, height)                       \
+static void prefix##_fill(const struct surface *surface,                              \
+                          int x1, int y1, int x2, int y2, unsigned short color) {      \
+    fill_kernel(surface->stats, surface->pixels, stride, width, height,               \
+                x1, y1, x2, y2, color);                                                \
+}                                                                                      \
+static void prefix##_blend(const struct surface *surface, int x1, int y1, int x2,     \
+                           int y2, unsigned short color, int alpha) {                  \
+    blend_kernel(surface->stats, surface->pixels, stride, width, height,              \
+                 x1, y1, x2, y2, color, alpha);                                        \
+}                                                                                      \
+static const struct raster_ops prefix##_ops = {                                       \
+    .name = label,                                                                     \
+    .clear = generic_clear,                                                            \
+    .fill = prefix##_fill,                                                             \
+    .blit = generic_blit,                                                              \
+    .blend = prefix##_blend,                                                           \
+    .blend_blit = generic_blend_blit,                                                  \
+};
+
+// Only the back buffer layout gets its own set. Fixed-geometry instances for
+// the lowres and overlay surfaces time no faster than generic in raster_bench.c.
+DEFINE_RASTER_OPS(generic, "generic", surface->stride, surface->width, surface->height)
+DEFINE_RASTER_OPS(vga, "vga", ROW_BYTES, VGA_WIDTH, VGA_HEIGHT)
+
+// Specialized kernels matching the surface geometry, or generic_ops if none do
+static inline const struct raster_ops *specialized_raster(const struct surface *surface) {
+    if (surface->width == VGA_WIDTH && surface->height == VGA_HEIGHT && surface->stride == ROW_BYTES)
+        return &vga_ops;
+    return &generic_ops;
+}
+
+// Pipe of the given width with its left edge at x, filled from the top of the
+// surface down to top_height and from the bottom of the gap to the bottom
+// edge. Pipes not wholly on the surface are skipped.
+static inline void draw_pipe(const struct raster_ops *ops, const struct surface *surface,
+                             int x, int width, int top_height, int gap_size, unsigned short color) {
+    if (x < 0 || x + width >= surface->width || top_height < 0)
+        return;
+
+    ops->fill(surface, x, 0, x + width - 1, top_height - 1, color);
+    ops->fill(surface, x, top_height + gap_size, x + width - 1, surface->height - 1, color);
+}
+
+// Opaque runs of an image in row order, pixels equal to key are transparent.
+// Returns the number of runs, which are stored to spans unless it is NULL.
+static inline int find_spans(const unsigned short *pixels, int width, int height, unsigned short key,
+                      struct sprite_span *spans) {
+    int x, y, start, count = 0;
+
+    if (!spans) {
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++) {
+                if (pixels[y * width + x] != key && (x == 0 || pixels[y * width + x - 1] == key))
+                    count++;
+            }
+        }
+        return count;
+    }
+
+    for (y = 0; y < height; y++) {
+        x = 0;
+        while (x < width) {
+            while (x < width && pixels[y * width + x] == key)
+                x++;
+            start = x;
+            while (x < width && pixels[y * width + x] != key)
+                x++;
+            if (x > start) {
+                spans[count].row = y;
+                spans[count].x = start;
+                spans[count].length = x - start;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Font rows for a character, lowercase maps to uppercase and anything else to '?'
+static inline const unsigned char *glyph_rows(char c) {
+    if (c >= 'a' && c <= 'z')
+        c -= 'a' - 'A';
+    if (c < FONT_FIRST_CHAR || c > FONT_LAST_CHAR)
+        c = '?';
+    return font5x7[c - FONT_FIRST_CHAR];
+}
+
+// Set the glyph pixels of text at scale in an image width pixels wide, which
+// must hold FONT_HEIGHT * scale rows of len * FONT_ADVANCE * scale - scale pixels.
+// Other pixels are left as they are, labels fill them with a key color first.
+static inline void rasterize_text(unsigned short *pixels, int width, int scale, unsigned short color,
+                                  const char *text) {
+    int i, row, col, x, y;
+
+    for (i = 0; text[i]; i++) {
+        const unsigned char *rows = glyph_rows(text[i]);
+        for (row = 0; row < FONT_HEIGHT; row++) {
+            for (col = 0; col < FONT_WIDTH; col++) {
+                if (!(rows[row] & (0x10 >> col)))
+                    continue;
+                for (y = row * scale; y < (row + 1) * scale; y++) {
+                    for (x = (i * FONT_ADVANCE + col) * scale; x < (i * FONT_ADVANCE + col + 1) * scale; x++)
+                        pixels[y * width + x] = color;
+                }
+            }
+        }
+    }
+}
+
+// Draw text glyph by glyph straight into the surface with its top-left corner
+// at (x, y), one clipped store per pixel. For text that changes too often to be
+// worth rasterizing once and blitting.
+static inline void draw_glyphs(const struct surface *surface, int x, int y, int scale, unsigned short color,
+                               const char *text) {
+    int row, col, px, py, filled = 0;
+
+    for (; *text; text++, x += FONT_ADVANCE * scale) {
+        const unsigned char *rows = glyph_rows(*text);
+        for (row = 0; row < FONT_HEIGHT; row++) {
+            for (col = 0; col < FONT_WIDTH; col++) {
+                if (!(rows[row] & (0x10 >> col)))
+                    continue;
+                for (py = y + row * scale; py < y + (row + 1) * scale; py++) {
+                    for (px = x + col * scale; px < x + (col + 1) * scale; px++) {
+                        if (px >= 0 && px < surface->width && py >= 0 && py < surface->height) {
+                            *(volatile short int *)(surface->pixels + (py * surface->stride) + (px * 2)) = color;
+                            filled++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    atomic64_add(filled, &surface->stats->pixels_filled);
+}
+
+#endif /* RASTER_H_ */
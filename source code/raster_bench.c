@@ -0,0 +1,604 @@
+// Host build of the driver's rasterizer (raster.h) for checking and timing it
+// off the board:
+//
+//     gcc -O2 -o raster_bench raster_bench.c
+//
+// Every kernel set is first checked against a golden image of a fixed scene,
+// the blend kernels against a plain per-channel blend, blitted labels against
+// the same text drawn glyph by glyph, lines against the per-pixel Bresenham
+// draw_line() replaced, and all of them for stores outside the surface, then
+// timed. Exits non-zero if a check fails, so a rasterizer
+// change can be verified before it goes into the module.
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "raster.h"
+
+#define PIPE_WIDTH 20           // Same as the driver and the game
+#define GUARD_COLOR 0xDEAD      // Fills the stride padding and the rows around the surface
+#define GUARD_ROWS 4
+#define BENCH_NANOSECONDS 200000000LL  // Time spent on each kernel
+#define GOLDEN_SCENE_HASH 0x73FDB548u  // draw_scene() hash at 320x240, any kernel set
+#define FRAME_NANOSECONDS 16666667     // One frame at 60 Hz
+
+// One surface geometry the driver draws into, with guard rows above and below
+typedef struct {
+    const char *name;
+    int stride, width, height;
+    unsigned short *memory;
+    struct surface surface;
+} Layout;
+
+static Layout layouts[] = {
+    { "vga", ROW_BYTES, VGA_WIDTH, VGA_HEIGHT },
+    { "lowres", VGA_WIDTH, VGA_WIDTH / 2, VGA_HEIGHT / 2 },
+    { "overlay", VGA_WIDTH * 2, VGA_WIDTH, VGA_HEIGHT },
+    { "odd", 642, 321, 200 },   // Rows not word aligned
+};
+
+// Text rasterized once into an image, drawn with blit like the driver's labels
+typedef struct {
+    const char *text;
+    int scale, width;
+    unsigned short *pixels;
+    struct sprite_span *spans;
+    int span_count;
+} Label;
+
+// The game's labels: the game over title, the restart prompt and a score
+static Label labels[] = {
+    { "GAME OVER", 3 },
+    { "PRESS KEY1 to restart", 1 },
+    { "105", 2 },
+};
+
+static struct raster_stats raster_stats;  // Drawing into any layout is counted here
+static unsigned short sprite_pixels[32 * 32];
+static double bench_ns;         // ns per call of the last BENCH()
+static struct sprite_span sprite_spans[64];
+static int sprite_span_count;
+
+static long long now_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static int layout_open(Layout *layout) {
+    size_t words = (size_t)layout->stride / 2 * (layout->height + 2 * GUARD_ROWS);
+
+    layout->memory = malloc(words * sizeof(unsigned short));
+    if (layout->memory == NULL) {
+        perror("Error allocating a surface");
+        return -1;
+    }
+    for (size_t i = 0; i < words; i++) {
+        layout->memory[i] = GUARD_COLOR;
+    }
+    layout->surface.pixels = (char *)layout->memory + GUARD_ROWS * layout->stride;
+    layout->surface.stride = layout->stride;
+    layout->surface.width = layout->width;
+    layout->surface.height = layout->height;
+    layout->surface.stats = &raster_stats;
+    return 0;
+}
+
+static const unsigned short *layout_pixel(const Layout *layout, int x, int y) {
+    return (const unsigned short *)((const char *)layout->surface.pixels + y * layout->stride + x * 2);
+}
+
+// Count guard pixels that were drawn over, anywhere outside width x height
+static long layout_stray(const Layout *layout) {
+    int row = layout->stride / 2;
+    long stray = 0;
+
+    for (int y = -GUARD_ROWS; y < layout->height + GUARD_ROWS; y++) {
+        for (int x = 0; x < row; x++) {
+            int inside = y >= 0 && y < layout->height && x < layout->width;
+            if (!inside && *layout_pixel(layout, x, y) != GUARD_COLOR) {
+                stray++;
+            }
+        }
+    }
+    return stray;
+}
+
+// FNV-1a over the visible pixels, row by row
+static unsigned int layout_hash(const Layout *layout) {
+    unsigned int hash = 2166136261u;
+
+    for (int y = 0; y < layout->height; y++) {
+        for (int x = 0; x < layout->width; x++) {
+            unsigned short p = *layout_pixel(layout, x, y);
+            hash = (hash ^ (p & 0xFF)) * 16777619u;
+            hash = (hash ^ (p >> 8)) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+// A bird-like sprite with a transparent border and a hole, kept as opaque runs
+static void build_sprite(void) {
+    for (int y = 0; y < 32; y++) {
+        int start = -1;
+
+        for (int x = 0; x <= 32; x++) {
+            int dx = x - 16, dy = y - 16;
+            int opaque = x < 32 && dx * dx + dy * dy < 15 * 15 && (dx * dx + dy * dy > 4 * 4 || dx > 0);
+
+            if (x < 32) {
+                sprite_pixels[y * 32 + x] = opaque ? (unsigned short)(0xF800 | (y << 6) | x) : 0xF81F;
+            }
+            if (opaque && start < 0) {
+                start = x;
+            } else if (!opaque && start >= 0) {
+                sprite_spans[sprite_span_count++] = (struct sprite_span){ y, start, x - start };
+                start = -1;
+            }
+        }
+    }
+}
+
+// Fixed scene touching every kernel, including clipped and fully off-surface
+// shapes. Coordinates are scaled to the surface so every layout draws it.
+static void draw_scene(const struct raster_ops *ops, const struct surface *surface) {
+    int w = surface->width, h = surface->height;
+
+    ops->clear(surface);
+    ops->fill(surface, -10, h - h / 10, w + 10, h + 10, 0x8A22);
+    for (int i = 0; i < 4; i++) {
+        draw_pipe(ops, surface, i * w / 4 + 7, PIPE_WIDTH * w / VGA_WIDTH, h / 5 + i * h / 12, h / 3, 0x07E0);
+    }
+    ops->fill(surface, w / 3, h / 3, w / 3 + 31, h / 3 + 17, 0xFFE0);
+    ops->fill(surface, w - 5, -5, w + 40, 5, 0x001F);
+    ops->fill(surface, w + 1, h + 1, w + 20, h + 20, 0xFFFF);
+    ops->fill(surface, 9, 9, 3, 3, 0xFFFF);
+
+    // Lines in all eight octants from the center, then clipped ones through the edges
+    for (int a = 0; a < 16; a++) {
+        static const int dx[16] = { 60, 60, 30, 0, -30, -60, -60, -60, -60, -60, -30, 0, 30, 60, 60, 60 };
+        static const int dy[16] = { 0, 30, 60, 60, 60, 30, 0, -13, -30, -60, -60, -60, -60, -30, -17, 7 };
+        draw_line(surface, w / 2, h / 2, w / 2 + dx[a] * w / VGA_WIDTH, h / 2 + dy[a] * h / VGA_HEIGHT,
+                  0xF800 + a);
+    }
+    draw_line(surface, -50, -20, w + 50, h + 30, 0x07FF);
+    draw_line(surface, w + 10, -40, -30, h + 5, 0xF81F);
+    draw_line(surface, -5, h / 2, w + 5, h / 2 + 1, 0xFFFF);
+    draw_line(surface, -100, -100, -10, h + 100, 0x1234);
+    // Endpoints so far apart their differences overflow an int
+    draw_line(surface, INT_MIN, 0, INT_MAX, 5, 0x7BEF);
+    draw_line(surface, 10, -1500000000, 20, 1500000000, 0x7BEF);
+
+    for (int i = 0; i < 50; i++) {
+        plot_pixel(surface, (i * 37) % (w + 20) - 10, (i * 53) % (h + 20) - 10, 0xABCD);
+    }
+
+    ops->blit(surface, sprite_pixels, 32, sprite_spans, sprite_span_count, w / 2 - 16, h / 2 - 16);
+    ops->blit(surface, sprite_pixels, 32, sprite_spans, sprite_span_count, -20, h - 12);
+    ops->blit(surface, sprite_pixels, 32, sprite_spans, sprite_span_count, w - 9, -19);
+}
+
+// Rasterize label->text the way the driver's create_label() does
+static int label_open(Label *label) {
+    int scale = label->scale;
+    int height = FONT_HEIGHT * scale;
+    unsigned short key = 0xF81F;
+
+    label->width = (int)strlen(label->text) * FONT_ADVANCE * scale - scale;
+    label->pixels = malloc((size_t)label->width * height * sizeof(unsigned short));
+    if (label->pixels == NULL) {
+        perror("Error allocating a label");
+        return -1;
+    }
+    for (int i = 0; i < label->width * height; i++) {
+        label->pixels[i] = key;
+    }
+    rasterize_text(label->pixels, label->width, scale, 0xFFFF, label->text);
+    label->span_count = find_spans(label->pixels, label->width, height, key, NULL);
+    label->spans = malloc(label->span_count * sizeof(struct sprite_span));
+    if (label->spans == NULL) {
+        perror("Error allocating label spans");
+        return -1;
+    }
+    find_spans(label->pixels, label->width, height, key, label->spans);
+    return 0;
+}
+
+static void label_close(Label *label) {
+    free(label->pixels);
+    free(label->spans);
+}
+
+// Draw the scene with ops and check it against the reference image drawn with
+// generic_ops, the golden hash and the guard pixels
+static int check(Layout *layout, const struct raster_ops *ops, const unsigned short *reference) {
+    int row = layout->stride / 2;
+    long differ = 0, stray;
+    unsigned int hash;
+    int ok;
+
+    draw_scene(ops, &layout->surface);
+    for (int y = 0; y < layout->height; y++) {
+        for (int x = 0; x < layout->width; x++) {
+            differ += *layout_pixel(layout, x, y) != reference[y * row + x];
+        }
+    }
+    stray = layout_stray(layout);
+    hash = layout_hash(layout);
+    ok = differ == 0 && stray == 0;
+    if (layout->width == VGA_WIDTH && layout->height == VGA_HEIGHT) {
+        ok = ok && hash == GOLDEN_SCENE_HASH;
+    }
+    printf("%-8s %-8s hash %08X, %ld pixels differ from generic, %ld stray stores: %s\n",
+           layout->name, ops->name, hash, differ, stray, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// The per-pixel Bresenham draw_line() replaced: every point goes through
+// plot_pixel() and its bounds check, off-surface points included
+static void reference_line(const struct surface *surface, int x0, int y0, int x1, int y1, short int color) {
+    int is_steep, temp, deltax, deltay, error, y, y_step, x;
+
+    is_steep = (abs(y1 - y0) > abs(x1 - x0));
+    if (is_steep) {
+        temp = x0; x0 = y0; y0 = temp;
+        temp = x1; x1 = y1; y1 = temp;
+    }
+    if (x0 > x1) {
+        temp = x0; x0 = x1; x1 = temp;
+        temp = y0; y0 = y1; y1 = temp;
+    }
+
+    deltax = x1 - x0;
+    deltay = abs(y1 - y0);
+    error = -(deltax / 2);
+    y = y0;
+    y_step = (y0 < y1) ? 1 : -1;
+    for (x = x0; x <= x1; x++) {
+        if (is_steep) {
+            plot_pixel(surface, y, x, color);
+        } else {
+            plot_pixel(surface, x, y, color);
+        }
+        error += deltay;
+        if (error >= 0) {
+            y += y_step;
+            error -= deltax;
+        }
+    }
+}
+
+// Whether (x, y) is inside the line's bounding box and on the ideal line along
+// the minor axis: within half a pixel, plus the 1 / (2 * length) Bresenham
+// rounds odd lengths up by when it starts the error at -(length / 2)
+static int on_line(int x, int y, int x0, int y0, int x1, int y1) {
+    long long dx = (long long)x1 - x0, dy = (long long)y1 - y0;
+    long long error = 2 * ((y - y0) * dx - (x - x0) * dy);
+
+    if (x < (x0 < x1 ? x0 : x1) || x > (x0 < x1 ? x1 : x0) ||
+        y < (y0 < y1 ? y0 : y1) || y > (y0 < y1 ? y1 : y0)) {
+        return 0;
+    }
+    return llabs(error) <= (llabs(dx) > llabs(dy) ? llabs(dx) : llabs(dy)) + 1;
+}
+
+// Random lines, most of them clipped, drawn by draw_line() and reference_line().
+// Each has to put the same number of pixels on the surface, all of them on the
+// ideal line, so the two may only differ where the line passes exactly halfway
+// between two pixels.
+static int check_lines(Layout *layout) {
+    int row = layout->stride / 2;
+    int w = layout->width, h = layout->height;
+    unsigned short *expected = malloc((size_t)layout->stride * h);
+    unsigned int seed = 54321;
+    long differ = 0, drawn = 0, off = 0, counts = 0, stray;
+    int ok;
+
+    if (expected == NULL) {
+        perror("Error allocating the expected image");
+        return 0;
+    }
+    for (int i = 0; i < 2000; i++) {
+        int c[4];
+        long reference_count = 0, count = 0;
+
+        for (int k = 0; k < 4; k++) {
+            seed = seed * 1103515245u + 12345u;
+            c[k] = (int)(seed >> 8) % (2 * (k % 2 ? h : w)) - (k % 2 ? h : w) / 2;
+        }
+        if (i % 10 == 1) c[3] = c[1];   // Horizontal
+        if (i % 10 == 2) c[2] = c[0];   // Vertical
+
+        generic_ops.clear(&layout->surface);
+        reference_line(&layout->surface, c[0], c[1], c[2], c[3], (short int)0xFFFF);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                expected[y * row + x] = *layout_pixel(layout, x, y);
+                reference_count += expected[y * row + x] != 0;
+            }
+        }
+        generic_ops.clear(&layout->surface);
+        draw_line(&layout->surface, c[0], c[1], c[2], c[3], (short int)0xFFFF);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                unsigned short p = *layout_pixel(layout, x, y);
+
+                if (p != 0) {
+                    count++;
+                    off += !on_line(x, y, c[0], c[1], c[2], c[3]);
+                }
+                differ += p != expected[y * row + x];
+            }
+        }
+        drawn += count;
+        counts += count != reference_count;
+    }
+    stray = layout_stray(layout);
+    ok = off == 0 && counts == 0 && stray == 0;
+    printf("%-8s lines    %ld of %ld pixels differ from per pixel, %ld off the line, "
+           "%ld lines miscounted, %ld stray stores: %s\n",
+           layout->name, differ / 2, drawn, off, counts, stray, ok ? "ok" : "FAILED");
+    free(expected);
+    return ok;
+}
+
+// Each label blitted, centered and clipped at the top right corner, has to
+// match the same text drawn glyph by glyph
+static int check_text(Layout *layout, const struct raster_ops *ops) {
+    int row = layout->stride / 2;
+    int count = sizeof(labels) / sizeof(labels[0]);
+    unsigned short *expected = malloc((size_t)layout->stride * layout->height);
+    long differ = 0, stray;
+    int ok;
+
+    if (expected == NULL) {
+        perror("Error allocating the expected image");
+        return 0;
+    }
+    ops->clear(&layout->surface);
+    for (int i = 0; i < count; i++) {
+        Label *label = &labels[i];
+        int x = (layout->width - label->width) / 2, y = layout->height * i / count;
+
+        draw_glyphs(&layout->surface, x, y, label->scale, 0xFFFF, label->text);
+        draw_glyphs(&layout->surface, layout->width - label->width / 2, -3, label->scale, 0xFFFF, label->text);
+    }
+    memcpy(expected, (const void *)layout->surface.pixels, (size_t)layout->stride * layout->height);
+
+    ops->clear(&layout->surface);
+    for (int i = 0; i < count; i++) {
+        Label *label = &labels[i];
+        int x = (layout->width - label->width) / 2, y = layout->height * i / count;
+
+        ops->blit(&layout->surface, label->pixels, label->width, label->spans, label->span_count, x, y);
+        ops->blit(&layout->surface, label->pixels, label->width, label->spans, label->span_count,
+                  layout->width - label->width / 2, -3);
+    }
+    for (int y = 0; y < layout->height; y++) {
+        for (int x = 0; x < layout->width; x++) {
+            differ += *layout_pixel(layout, x, y) != expected[y * row + x];
+        }
+    }
+    stray = layout_stray(layout);
+    ok = differ == 0 && stray == 0;
+    printf("%-8s %-8s text, %ld pixels differ from glyph by glyph, %ld stray stores: %s\n",
+           layout->name, ops->name, differ, stray, ok ? "ok" : "FAILED");
+    free(expected);
+    return ok;
+}
+
+// Per-channel blend the packed blend kernels have to match exactly
+static unsigned short reference_blend(unsigned short dst, unsigned short src, int alpha) {
+    int keep = ALPHA_ONE - alpha;
+    int r = ((src >> 11) * alpha + (dst >> 11) * keep) >> 5;
+    int g = (((src >> 5) & 0x3F) * alpha + ((dst >> 5) & 0x3F) * keep) >> 5;
+    int b = ((src & 0x1F) * alpha + (dst & 0x1F) * keep) >> 5;
+
+    return (unsigned short)(r << 11 | g << 5 | b);
+}
+
+// Busy background so every channel value meets every weight
+static void fill_noise(Layout *layout, unsigned short *copy) {
+    int row = layout->stride / 2;
+    unsigned int seed = 12345;
+
+    for (int y = 0; y < layout->height; y++) {
+        for (int x = 0; x < layout->width; x++) {
+            seed = seed * 1103515245u + 12345u;
+            copy[y * row + x] = (unsigned short)(seed >> 16);
+            *(unsigned short *)layout_pixel(layout, x, y) = copy[y * row + x];
+        }
+    }
+}
+
+// Blend boxes starting on odd and even pixels and clipped sprites at every
+// weight, then compare with reference_blend() applied pixel by pixel
+static int check_blend(Layout *layout, const struct raster_ops *ops) {
+    int row = layout->stride / 2;
+    int w = layout->width, h = layout->height;
+    unsigned short *expected = malloc((size_t)layout->stride * h);
+    long differ = 0, stray;
+    int ok;
+
+    if (expected == NULL) {
+        perror("Error allocating the expected image");
+        return 0;
+    }
+    fill_noise(layout, expected);
+    for (int alpha = 0; alpha <= ALPHA_ONE; alpha++) {
+        int x1 = alpha * 3 % 17 - 4, y1 = alpha * 5 % 23 - 3;
+        int x2 = w - 1 - alpha % 5 + 3, y2 = y1 + 6;
+        unsigned short color = (unsigned short)(0x1234 * (alpha + 1));
+        int sx = w - 20 - alpha, sy = alpha * 7 % (h - 8) - 8;
+
+        ops->blend(&layout->surface, x1, y1, x2, y2, color, alpha);
+        for (int y = (y1 < 0 ? 0 : y1); y <= y2 && y < h; y++) {
+            for (int x = (x1 < 0 ? 0 : x1); x <= x2 && x < w; x++) {
+                expected[y * row + x] = reference_blend(expected[y * row + x], color, alpha);
+            }
+        }
+
+        ops->blend_blit(&layout->surface, sprite_pixels, 32, sprite_spans, sprite_span_count, sx, sy, alpha);
+        for (int i = 0; i < sprite_span_count; i++) {
+            const struct sprite_span *span = &sprite_spans[i];
+            int y = sy + span->row;
+
+            for (int x = sx + span->x; x < sx + span->x + span->length; x++) {
+                if (x >= 0 && x < w && y >= 0 && y < h) {
+                    expected[y * row + x] = reference_blend(expected[y * row + x],
+                                                            sprite_pixels[span->row * 32 + x - sx], alpha);
+                }
+            }
+        }
+    }
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            differ += *layout_pixel(layout, x, y) != expected[y * row + x];
+        }
+    }
+    stray = layout_stray(layout);
+    ok = differ == 0 && stray == 0;
+    printf("%-8s %-8s blend, %ld pixels differ from the per-channel blend, %ld stray stores: %s\n",
+           layout->name, ops->name, differ, stray, ok ? "ok" : "FAILED");
+    free(expected);
+    return ok;
+}
+
+// ns per call of one kernel and the fill rate it reached, from the fastest
+// batch of 64 calls so a preempted batch doesn't decide between kernel sets
+#define BENCH(label, call)                                                                     \
+    do {                                                                                       \
+        long long start = now_ns(), best = LLONG_MAX, best_filled = 0;                         \
+        do {                                                                                   \
+            long long filled = atomic64_read(&raster_stats.pixels_filled);                     \
+            long long batch = now_ns();                                                        \
+            for (int i = 0; i < 64; i++) {                                                     \
+                call;                                                                          \
+            }                                                                                  \
+            batch = now_ns() - batch;                                                          \
+            if (batch < best) {                                                                \
+                best = batch;                                                                  \
+                best_filled = atomic64_read(&raster_stats.pixels_filled) - filled;             \
+            }                                                                                  \
+        } while (now_ns() - start < BENCH_NANOSECONDS);                                        \
+        bench_ns = best / 64.0;                                                                \
+        printf("  %-10s %9.0f ns/call %9.1f Mpixel/s\n", label, bench_ns,                      \
+               best_filled * 1e3 / best);                                                      \
+    } while (0)
+
+static void bench(const Layout *layout, const struct raster_ops *ops) {
+    const struct surface *s = &layout->surface;
+    int w = s->width, h = s->height;
+    double line_ns;
+
+    printf("%s %dx%d stride %d, %s kernels\n", layout->name, w, h, s->stride, ops->name);
+    BENCH("clear", ops->clear(s));
+    BENCH("fill", ops->fill(s, 0, 0, w - 1, h - 1, 0x07E0));
+    BENCH("box32", ops->fill(s, i, i, i + 31, i + 31, 0xFFE0));
+    BENCH("pipe", draw_pipe(ops, s, i, PIPE_WIDTH, h / 3, h / 4, 0x07E0));
+    BENCH("blit32", ops->blit(s, sprite_pixels, 32, sprite_spans, sprite_span_count, i, i));
+    // Run-slice lines against the per-pixel Bresenham they replaced
+    BENCH("line", draw_line(s, i, 0, w - 1 - i, h - 1, 0xF800));
+    line_ns = bench_ns;
+    BENCH("plot line", reference_line(s, i, 0, w - 1 - i, h - 1, 0xF800));
+    printf("  %.2fM lines/s, %.2fM per pixel\n", 1e3 / line_ns, 1e3 / bench_ns);
+    BENCH("hline", draw_line(s, 0, i, w - 1, i, 0xF800));
+    line_ns = bench_ns;
+    BENCH("plot hline", reference_line(s, 0, i, w - 1, i, 0xF800));
+    printf("  %.2fM lines/s, %.2fM per pixel\n", 1e3 / line_ns, 1e3 / bench_ns);
+    BENCH("vline", draw_line(s, i, 0, i, h - 1, 0xF800));
+    line_ns = bench_ns;
+    BENCH("plot vline", reference_line(s, i, 0, i, h - 1, 0xF800));
+    printf("  %.2fM lines/s, %.2fM per pixel\n", 1e3 / line_ns, 1e3 / bench_ns);
+    BENCH("plot", plot_pixel(s, i, i, 0xFFFF));
+    BENCH("blend32", ops->blend_blit(s, sprite_pixels, 32, sprite_spans, sprite_span_count, i, i,
+                                     ALPHA_ONE / 2));
+    BENCH("blend", ops->blend(s, 0, 0, w - 1, h - 1, 0x0000, ALPHA_ONE / 2));
+    printf("  full-surface blend is %.1f%% of a 60 Hz frame\n", 100.0 * bench_ns / FRAME_NANOSECONDS);
+
+    // Text each frame, glyph by glyph as ptext draws it or as one blit of a cached label
+    for (int l = 0; l < (int)(sizeof(labels) / sizeof(labels[0])); l++) {
+        const Label *label = &labels[l];
+        double glyphs_ns;
+
+        printf("  \"%s\" at scale %d\n", label->text, label->scale);
+        BENCH("glyphs", draw_glyphs(s, i, i, label->scale, 0xFFFF, label->text));
+        glyphs_ns = bench_ns;
+        BENCH("label", ops->blit(s, label->pixels, label->width, label->spans, label->span_count, i, i));
+        printf("  label blit takes %.0f%% of the glyph by glyph time\n", 100.0 * bench_ns / glyphs_ns);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int count = sizeof(layouts) / sizeof(layouts[0]);
+    int check_only = argc > 1 && strcmp(argv[1], "--check") == 0;
+    int ok = 1;
+
+    if (argc > 1 && !check_only) {
+        fprintf(stderr, "Usage: %s [--check]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    build_sprite();
+    for (int i = 0; i < (int)(sizeof(labels) / sizeof(labels[0])); i++) {
+        if (label_open(&labels[i]) == -1) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int l = 0; l < count; l++) {
+        Layout *layout = &layouts[l];
+        const struct raster_ops *special;
+        unsigned short *reference;
+        size_t size = (size_t)layout->stride * layout->height;
+
+        if (layout_open(layout) == -1) {
+            return EXIT_FAILURE;
+        }
+        reference = malloc(size);
+        if (reference == NULL) {
+            perror("Error allocating the reference image");
+            return EXIT_FAILURE;
+        }
+        draw_scene(&generic_ops, &layout->surface);
+        memcpy(reference, (const void *)layout->surface.pixels, size);
+
+        special = specialized_raster(&layout->surface);
+        ok = check(layout, &generic_ops, reference) && ok;
+        if (special != &generic_ops) {
+            ok = check(layout, special, reference) && ok;
+        }
+        free(reference);
+
+        ok = check_blend(layout, &generic_ops) && ok;
+        if (special != &generic_ops) {
+            ok = check_blend(layout, special) && ok;
+        }
+
+        ok = check_text(layout, &generic_ops) && ok;
+        if (special != &generic_ops) {
+            ok = check_text(layout, special) && ok;
+        }
+        ok = check_lines(layout) && ok;
+    }
+
+    if (!check_only) {
+        for (int l = 0; l < count; l++) {
+            const struct raster_ops *special = specialized_raster(&layouts[l].surface);
+
+            bench(&layouts[l], &generic_ops);
+            if (special != &generic_ops) {
+                bench(&layouts[l], special);
+            }
+        }
+    }
+    for (int l = 0; l < count; l++) {
+        free(layouts[l].memory);
+    }
+    for (int i = 0; i < (int)(sizeof(labels) / sizeof(labels[0])); i++) {
+        label_close(&labels[i]);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,180 @@
+#include <string.h>
+#include "replay.h"
+
+// FNV-1a over 32-bit words
+static uint32_t hash_word(uint32_t hash, uint32_t word) {
+    for (int i = 0; i < 4; i++) {
+        hash ^= (word >> (i * 8)) & 0xFF;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Hash of every tuning constant game.c and pipes.c read, so a log recorded
+// against different physics, hitboxes or pipe generation is rejected instead
+// of desyncing
+uint32_t replay_config(void) {
+    uint32_t hash = 2166136261u;
+
+    hash = hash_word(hash, (uint32_t)(SCROLL_SPEED * SCROLL_SPEED_MULTIPLIER));
+    hash = hash_word(hash, SCROLL_SPEED_MULTIPLIER);
+    hash = hash_word(hash, GRAVITY_SPEED);
+    hash = hash_word(hash, GRAVITY_MULTIPLIER);
+    hash = hash_word(hash, FLAP_DISTANCE);
+    hash = hash_word(hash, BOTTOM_MARGIN);
+    hash = hash_word(hash, BIRD_BODY_WIDTH);
+    hash = hash_word(hash, BIRD_BODY_HEIGHT);
+    hash = hash_word(hash, BIRD_HEAD_SIZE);
+    hash = hash_word(hash, BIRD_BEAK_SIZE);
+    hash = hash_word(hash, PIPE_WIDTH);
+    hash = hash_word(hash, PIPE_RING_SIZE);
+    hash = hash_word(hash, GAP_SIZE);
+    hash = hash_word(hash, MIN_GAP_SIZE);
+    hash = hash_word(hash, MIN_PIPE_HEIGHT);
+    hash = hash_word(hash, MAX_PIPE_HEIGHT_DIFF);
+    hash = hash_word(hash, PIPE_SPACING);
+    hash = hash_word(hash, MIN_PIPE_SPACING);
+    hash = hash_word(hash, PIPE_SPACING_JITTER);
+    hash = hash_word(hash, DIFFICULTY_STEP);
+    return hash;
+}
+
+// Hash of the state a replay should reproduce, printed at the end of a run
+uint32_t replay_checksum(const GameState *game) {
+    uint32_t hash = 2166136261u;
+
+    hash = hash_word(hash, (uint32_t)game->tick);
+    hash = hash_word(hash, game->score);
+    hash = hash_word(hash, game->high_score);
+    hash = hash_word(hash, game->game_over);
+    hash = hash_word(hash, game->bird.y);
+    hash = hash_word(hash, game->bird.velocity);
+    hash = hash_word(hash, game->pipes.rng);
+    hash = hash_word(hash, game->pipes.scroll);
+    hash = hash_word(hash, game->pipes.spawned);
+    return hash;
+}
+
+int replay_open_record(Replay *replay, const char *path, uint32_t seed,
+                       int tick_hz, int screen_x, int screen_y) {
+    memset(replay, 0, sizeof(*replay));
+    replay->file = fopen(path, "wb");
+    if (replay->file == NULL) {
+        perror(path);
+        return -1;
+    }
+    replay->recording = 1;
+    replay->header.magic = REPLAY_MAGIC;
+    replay->header.version = REPLAY_VERSION;
+    replay->header.tick_hz = tick_hz;
+    replay->header.seed = seed;
+    replay->header.config = replay_config();
+    replay->header.screen_x = screen_x;
+    replay->header.screen_y = screen_y;
+
+    // Rewritten with the tick count when the recording is closed
+    if (fwrite(&replay->header, sizeof(replay->header), 1, replay->file) != 1) {
+        fclose(replay->file);
+        replay->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void write_run(Replay *replay) {
+    uint16_t word = (uint16_t)((replay->keys << REPLAY_KEY_SHIFT) | replay->run);
+
+    fwrite(&word, sizeof(word), 1, replay->file);
+}
+
+// Append one tick of input, runs are written out when the keys change
+void replay_record(Replay *replay, int keys) {
+    keys &= 0xF;
+    if (replay->run > 0 && (keys != replay->keys || replay->run == REPLAY_MAX_RUN)) {
+        write_run(replay);
+        replay->run = 0;
+    }
+    replay->keys = keys;
+    replay->run++;
+    replay->tick++;
+}
+
+int replay_open_play(Replay *replay, const char *path, int tick_hz) {
+    memset(replay, 0, sizeof(*replay));
+    replay->file = fopen(path, "rb");
+    if (replay->file == NULL) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&replay->header, sizeof(replay->header), 1, replay->file) != 1 ||
+        replay->header.magic != REPLAY_MAGIC || replay->header.version != REPLAY_VERSION) {
+        fprintf(stderr, "%s is not a replay file\n", path);
+        fclose(replay->file);
+        replay->file = NULL;
+        return -1;
+    }
+    if (replay->header.config != replay_config()) {
+        fprintf(stderr, "%s was recorded with different game settings\n", path);
+        fclose(replay->file);
+        replay->file = NULL;
+        return -1;
+    }
+    if (replay->header.tick_hz != tick_hz) {
+        fprintf(stderr, "%s was recorded at %d ticks per second, the game runs at %d\n",
+                path, replay->header.tick_hz, tick_hz);
+        fclose(replay->file);
+        replay->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Keys for the next tick, or -1 once the log is exhausted
+int replay_next(Replay *replay) {
+    uint16_t word;
+
+    while (replay->run == 0) {
+        if (replay->tick >= replay->header.ticks || fread(&word, sizeof(word), 1, replay->file) != 1) {
+            return -1;
+        }
+        replay->keys = word >> REPLAY_KEY_SHIFT;
+        replay->run = word & REPLAY_MAX_RUN;
+    }
+    replay->run--;
+    replay->tick++;
+    return replay->keys;
+}
+
+// Start playing the log over from its first tick
+int replay_rewind(Replay *replay) {
+    if (fseek(replay->file, sizeof(replay->header), SEEK_SET) != 0) {
+        return -1;
+    }
+    replay->run = 0;
+    replay->tick = 0;
+    return 0;
+}
+
+// Finish the file. A recording gets its last run and the final tick count.
+int replay_close(Replay *replay) {
+    int ret = 0;
+
+    if (replay->file == NULL) {
+        return 0;
+    }
+    if (replay->recording) {
+        if (replay->run > 0) {
+            write_run(replay);
+        }
+        replay->header.ticks = replay->tick;
+        if (fseek(replay->file, 0, SEEK_SET) != 0 ||
+            fwrite(&replay->header, sizeof(replay->header), 1, replay->file) != 1) {
+            ret = -1;
+        }
+    }
+    if (fclose(replay->file) != 0) {
+        ret = -1;
+    }
+    replay->file = NULL;
+    return ret;
+}
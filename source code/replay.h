@@ -0,0 +1,46 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include "game.h"
+
+#define REPLAY_MAGIC 0x50524246     // "FBRP" in a little-endian file
+#define REPLAY_VERSION 1
+#define REPLAY_KEY_SHIFT 12         // Each run is one 16-bit word, keys in the top 4 bits
+#define REPLAY_MAX_RUN 0x0FFF       // and the number of ticks they were held below them
+
+// File header, written in the board's native (little-endian) byte order
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t tick_hz;       // Simulation rate the input was sampled at
+    uint32_t seed;          // Passed to game_init()
+    uint32_t config;        // replay_config() of the game that recorded it
+    int16_t screen_x, screen_y;
+    uint32_t ticks;         // Ticks in the file, filled in by replay_close()
+} ReplayHeader;
+
+// Input log being recorded or played back. The KEY bits of each tick are
+// stored as runs, a held or idle button costs one word per 4095 ticks.
+typedef struct {
+    FILE *file;
+    int recording;
+    ReplayHeader header;
+    int keys;               // Keys of the current run
+    unsigned int run;       // Ticks recorded into, or left to play from, the current run
+    unsigned long tick;     // Ticks recorded or played so far
+} Replay;
+
+// Function prototypes
+uint32_t replay_config(void);
+uint32_t replay_checksum(const GameState *game);
+int replay_open_record(Replay *replay, const char *path, uint32_t seed,
+                       int tick_hz, int screen_x, int screen_y);
+void replay_record(Replay *replay, int keys);
+int replay_open_play(Replay *replay, const char *path, int tick_hz);
+int replay_next(Replay *replay);
+int replay_rewind(Replay *replay);
+int replay_close(Replay *replay);
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,69 @@
+#include <string.h>
+#include "snapshot.h"
+
+void snapshot_init(Snapshot *snapshot) {
+    snapshot->front = 0;
+    snapshot->sequence = 0;
+    snapshot->closed = 0;
+    pthread_mutex_init(&snapshot->lock, NULL);
+    pthread_cond_init(&snapshot->ready, NULL);
+}
+
+void snapshot_destroy(Snapshot *snapshot) {
+    pthread_cond_destroy(&snapshot->ready);
+    pthread_mutex_destroy(&snapshot->lock);
+}
+
+// Publish a new state. Only the writer changes front, and the reader only
+// touches the front slot, so the back slot can be filled outside the lock.
+// race may be NULL when no ghosts are flying.
+void snapshot_publish(Snapshot *snapshot, const GameState *state, const RaceFrame *race,
+                      const struct timespec *stamp) {
+    int back = !snapshot->front;
+
+    snapshot->state[back] = *state;
+    if (race) {
+        snapshot->race[back].count = race->count;
+        memcpy(snapshot->race[back].y, race->y, race->count * sizeof(race->y[0]));
+    } else {
+        snapshot->race[back].count = 0;
+    }
+    snapshot->stamp[back] = *stamp;
+
+    pthread_mutex_lock(&snapshot->lock);
+    snapshot->front = back;
+    snapshot->sequence++;
+    pthread_cond_signal(&snapshot->ready);
+    pthread_mutex_unlock(&snapshot->lock);
+}
+
+// Wait for a state newer than last_sequence and copy it out. Returns the new
+// sequence number, or 0 once the writer has closed the snapshot.
+unsigned long snapshot_wait(Snapshot *snapshot, unsigned long last_sequence,
+                            GameState *state, RaceFrame *race, struct timespec *stamp) {
+    unsigned long sequence;
+
+    pthread_mutex_lock(&snapshot->lock);
+    while (snapshot->sequence == last_sequence && !snapshot->closed) {
+        pthread_cond_wait(&snapshot->ready, &snapshot->lock);
+    }
+    if (snapshot->closed) {
+        pthread_mutex_unlock(&snapshot->lock);
+        return 0;
+    }
+    *state = snapshot->state[snapshot->front];
+    race->count = snapshot->race[snapshot->front].count;
+    memcpy(race->y, snapshot->race[snapshot->front].y, race->count * sizeof(race->y[0]));
+    *stamp = snapshot->stamp[snapshot->front];
+    sequence = snapshot->sequence;
+    pthread_mutex_unlock(&snapshot->lock);
+
+    return sequence;
+}
+
+void snapshot_close(Snapshot *snapshot) {
+    pthread_mutex_lock(&snapshot->lock);
+    snapshot->closed = 1;
+    pthread_cond_broadcast(&snapshot->ready);
+    pthread_mutex_unlock(&snapshot->lock);
+}
@@ -0,0 +1,33 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <pthread.h>
+#include <time.h>
+#include "game.h"
+#include "race.h"
+
+// Double-buffered hand-off of game state from the simulation thread to the
+// render thread. The writer fills the back slot without locking and flips it to
+// the front under the lock, the reader copies the front slot out under the same
+// lock, so neither side ever waits for the other's tick or frame to finish.
+typedef struct {
+    GameState state[2];
+    RaceFrame race[2];          // Ghosts flying alongside each state
+    struct timespec stamp[2];   // Start of the tick that produced each slot
+    int front;                  // Slot holding the latest published state
+    unsigned long sequence;     // Number of states published so far
+    int closed;                 // Set once the writer has stopped
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} Snapshot;
+
+// Function prototypes
+void snapshot_init(Snapshot *snapshot);
+void snapshot_destroy(Snapshot *snapshot);
+void snapshot_publish(Snapshot *snapshot, const GameState *state, const RaceFrame *race,
+                      const struct timespec *stamp);
+unsigned long snapshot_wait(Snapshot *snapshot, unsigned long last_sequence,
+                            GameState *state, RaceFrame *race, struct timespec *stamp);
+void snapshot_close(Snapshot *snapshot);
+
+#endif /* SNAPSHOT_H_ */
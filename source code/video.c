@@ -6,8 +6,20 @@
 #include <asm/io.h>
 #include <asm/uaccess.h>
 #include <linux/string.h>  
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/atomic.h>
 
 #include "address_map_arm.h"  
+#include "raster.h"
 
 #define SUCCESS 0
 #define DEVICE_NAME "video"
@@ -26,11 +38,29 @@
 #define BUFFER_SIZE 0x0003FFFF      // Buffer size
 #define STATUS_S_BIT 0x1        // S bit in Status register
 #define BUFFER_SWAP_TRIGGER 1   // Value to write to trigger buffer swap
+#define BENCH_REPEATS 200       // Calls of each kernel timed by debugfs video/bench
+#define COORD_LIMIT 32767       // Line endpoints are clamped to +/- this before clipping
 
 // VGA screen size constants for character buffer
 #define CHAR_WIDTH 80
 #define CHAR_HEIGHT 60
 
+// Sprite store
+#define MAX_SPRITES 16
+#define SPRITE_MAX_WIDTH 320        // Wide enough for a full-width text label
+#define SPRITE_MAX_HEIGHT 64
+#define LABEL_MAX_SCALE 4           // Largest glyph magnification for text
+#define MAX_LAYERS 4                // Parallax layers, drawn back to front by id
+#define LAYER_MAX_TILES 24
+#define MAX_INSTANCES 64            // Sprite copies drawn by one "instances" command
+
+// Overlay clients
+#define OVERLAY_KEY 0x0000          // Transparent overlay color, what "clear" fills with
+#define OVERLAY_MIN_Z 1             // The screen owner's frame is always at the bottom
+
+// Command profiling
+#define PROFILE_BUCKETS 18          // Power-of-two microsecond buckets, the last one open ended
+
 // Global variables for pixel buffer
 void *LW_virtual;                // Used to access FPGA lightweight bridge
 volatile int *pixel_ctrl_ptr;    // Virtual address of pixel buffer controller
@@ -43,6 +73,145 @@ int resolution_x, resolution_y;  // VGA screen size
 static volatile int *buffer_register;     // Pointer to Buffer register
 static volatile int *backbuffer_register; // Pointer to Backbuffer register
 
+// Pre-rasterized RGB565 sprite, uploaded once and drawn with "blit"
+struct sprite {
+    int width, height;
+    unsigned short *pixels;
+    struct sprite_span *spans;  // Opaque runs in row order
+    int span_count;
+    unsigned short *tinted;     // Pixels blended with tint, made by the first instance that asks
+    unsigned short tint;
+};
+
+// One copy of a stored sprite in an "instances" batch, in the binary layout
+// user space sends. A tint of 0 keeps the sprite's own colors.
+struct instance {
+    s16 x, y;
+    u16 id;
+    u16 tint;
+};
+
+// Horizontally repeating row of equal-size tiles copied out of the sprite store.
+// Each tile column keeps its own pixels and opaque runs, so a frame copies only
+// the columns on screen and a layer never costs more than one pass over its rows.
+struct layer {
+    int y;                      // Screen row of the top of the layer
+    int rate;                   // Scroll speed relative to the world, 8.8 fixed point
+    int tile_width, height;
+    int columns;                // Tiles before the layer wraps around
+    unsigned short *pixels;     // Column c is tile_width * height pixels at c * tile_width * height
+    struct sprite_span *spans;  // Opaque runs grouped by column
+    int *column_spans;          // First span of each column, columns + 1 entries
+};
+
+// Drawing state of one open file. The first client to open the device owns the
+// screen: it draws into the VGA back buffer, or in lowres mode into a half-size
+// buffer that "upscale" pixel-doubles into the back buffer, and presents with
+// "swap". Command coordinates stay in screen pixels and are shifted right by
+// lowres_shift when parsed. Every other client draws into an overlay of its
+// own, which the owner's "swap" composites over the back buffer by z.
+struct video_client {
+    int owner;                      // Draws into the back buffer and presents
+    struct surface target;
+    const struct raster_ops *raster;
+    unsigned short *lowres_buffer;
+    int lowres_shift;
+    struct sprite sprites[MAX_SPRITES];
+    struct layer layers[MAX_LAYERS];
+    unsigned short *background;     // Cached background, target.width * target.height packed pixels
+    struct instance instances[MAX_INSTANCES];  // Batch being drawn, copied in from user space
+
+    // Overlay clients only
+    int z;                          // Compose order, higher ends up on top
+    struct list_head node;          // Entry in overlays
+    struct sprite frames[2];        // Full-screen images with room for their worst-case spans
+    int shown;                      // Frame the compose reads, the other one is drawn into
+};
+
+// compose_lock guards the overlay list, each overlay's shown index and
+// screen_owner. Drawing never takes it, only opening and closing a client,
+// publishing an overlay frame, the compose itself and the debugfs bench.
+static DEFINE_MUTEX(compose_lock);
+static LIST_HEAD(overlays);         // Overlay clients sorted by z
+static struct video_client *screen_owner;
+
+// Stages of a command timed when the profile parameter is set
+enum {
+    PROF_PARSE,     // Copying and matching the command
+    PROF_RASTER,    // Drawing primitives and text
+    PROF_UPLOAD,    // Storing sprites and rasterizing labels
+    PROF_CLEAR,     // Clearing pixel buffers
+    PROF_SYNC,      // Waiting on the VGA controller in sync_vga()
+    PROF_SWAP,      // Waiting on the VGA controller in swap_buffers()
+    PROF_UPSCALE,   // Pixel-doubling the lowres buffer into the back buffer
+    PROF_COMPOSE,   // Drawing the overlays over the back buffer, under compose_lock
+    PROF_PUBLISH,   // Finding the opaque runs of an overlay frame
+    PROF_STAGES
+};
+
+// Fixed-bucket latency histogram for one stage, under profile_lock since
+// every client's writes are timed into the same stages
+struct profile_stage {
+    const char *name;
+    u64 count;
+    u64 total_ns;
+    u64 max_ns;
+    u32 buckets[PROFILE_BUCKETS];
+};
+
+static struct profile_stage profile_stages[PROF_STAGES] = {
+    [PROF_PARSE]  = { .name = "parse" },
+    [PROF_RASTER] = { .name = "raster" },
+    [PROF_UPLOAD] = { .name = "upload" },
+    [PROF_CLEAR]  = { .name = "clear" },
+    [PROF_SYNC]   = { .name = "sync" },
+    [PROF_SWAP]   = { .name = "swap" },
+    [PROF_UPSCALE] = { .name = "upscale" },
+    [PROF_COMPOSE] = { .name = "compose" },
+    [PROF_PUBLISH] = { .name = "publish" },
+};
+
+static DEFINE_SPINLOCK(profile_lock);
+
+// Command types counted in the driver statistics
+enum {
+    CMD_BOX, CMD_LINE, CMD_PIPE, CMD_BLIT, CMD_PTEXT, CMD_LABEL, CMD_SPRITE,
+    CMD_TEXT, CMD_ERASE, CMD_CLEAR, CMD_CLEAR_BOTH, CMD_SYNC, CMD_SWAP,
+    CMD_BG_SAVE, CMD_RESTORE, CMD_LAYER, CMD_PARALLAX, CMD_LOWRES, CMD_UPSCALE,
+    CMD_ZORDER, CMD_INSTANCES, CMD_BLEND, CMD_BLEND_BLIT,
+    CMD_TYPES
+};
+
+static const char *command_names[CMD_TYPES] = {
+    "box", "line", "pipe", "blit", "ptext", "label", "sprite",
+    "text", "erase", "clear", "clear_both", "sync", "swap",
+    "bg_save", "restore", "layer", "parallax", "lowres", "upscale",
+    "zorder", "instances", "blend", "blend_blit"
+};
+
+// Always-on counters, read from debugfs video/stats. Atomic since clients
+// write concurrently.
+struct video_stats {
+    atomic64_t commands[CMD_TYPES];
+    atomic64_t bytes_written;
+    atomic64_t parse_failures;  // Writes rejected as malformed or unknown
+    atomic64_t sync_spin_ns;    // Time spent polling the status register
+    atomic64_t swap_spin_ns;
+};
+
+static struct video_stats video_stats;
+static struct raster_stats raster_stats;  // Every surface the clients draw into counts here
+
+static int profile;
+module_param(profile, int, 0644);
+MODULE_PARM_DESC(profile, "Time each command stage, histograms in debugfs video/profile");
+
+static int generic_raster;
+module_param(generic_raster, int, 0444);
+MODULE_PARM_DESC(generic_raster, "Use the runtime-geometry raster kernels even on the DE1-SoC layout");
+
+static struct dentry *debugfs_dir;
+
 // Character device variables
 static dev_t dev_no;
 static struct class *cls;
@@ -54,15 +223,40 @@ static int device_release(struct inode *, struct file *);
 static ssize_t device_read(struct file *, char *, size_t, loff_t *);
 static ssize_t device_write(struct file *, const char *, size_t, loff_t *);
 void get_screen_specs(volatile int *);
-void clear_screen(void);
-void plot_pixel(int, int, short int);
-void draw_line(int, int, int, int, short int);
-void draw_box(int, int, int, int, short int);  
+void clear_screen(struct video_client *client);
+void blend_box(struct video_client *client, int x1, int y1, int x2, int y2, unsigned short color, int alpha);
+void select_target(struct video_client *client);
+void select_raster(struct video_client *client);
+int set_lowres(struct video_client *client, int enable);
+void upscale(struct video_client *client);
+int save_background(struct video_client *client);
+void restore_background(struct video_client *client, int x1, int y1, int x2, int y2);
+void draw_box(struct video_client *client, int, int, int, int, short int);
 void sync_vga(void);  
 void swap_buffers(void);
 void clear_text_buffer(void);
 void draw_text(int x, int y, const char *text);
-void draw_pipe_direct(int x, int top_height, int gap_size, short int color);
+void draw_pipe_direct(struct video_client *client, int x, int top_height, int gap_size, short int color);
+int store_sprite(struct video_client *client, int id, int width, int height, unsigned short key,
+                 unsigned short *pixels);
+int load_sprite(struct video_client *client, int id, int width, int height, unsigned short key,
+                const char *data, size_t size);
+int create_label(struct video_client *client, int id, int scale, unsigned short color, const char *text);
+void draw_glyph_text(struct video_client *client, int x, int y, int scale, unsigned short color,
+                     const char *text);
+void free_sprite(struct video_client *client, int id);
+void blit_sprite(struct video_client *client, int id, int x, int y);
+void blend_sprite(struct video_client *client, int id, int x, int y, int alpha);
+int draw_instances(struct video_client *client, const char *data, size_t size, int count);
+void free_layer(struct video_client *client, int id);
+int create_layer(struct video_client *client, int id, int y, int rate, const int *tiles, int count);
+void draw_layers(struct video_client *client, u64 scroll, int count);
+int open_overlay(struct video_client *client);
+void close_overlay(struct video_client *client);
+void set_overlay_z(struct video_client *client, int z);
+void publish_overlay(struct video_client *client);
+void compose_overlays(void);
+static u64 profile_mark(int stage, u64 start);
 
 // File operation structure
 static struct file_operations fops = {
@@ -82,34 +276,8 @@ void clear_text_buffer(void) {
     }
 }
 
-void draw_pipe_direct(int x, int top_height, int gap_size, short int color) {
-    int y, i;
-    int max_top;
-    int bottom_y_start;
-    
-    // Bounds checking
-    if (x < 0 || x + PIPE_WIDTH >= resolution_x || top_height < 0) {
-        return;
-    }
-
-    max_top = (top_height < resolution_y) ? top_height : resolution_y;
-    
-    // Draw top section of pipe
-    for (y = 0; y < max_top; y++) {
-        for (i = 0; i < PIPE_WIDTH && (x + i) < resolution_x; i++) {
-            plot_pixel(x + i, y, color);
-        }
-    }
-
-    // Draw bottom section
-    bottom_y_start = top_height + gap_size;
-    if (bottom_y_start < resolution_y) {
-        for (y = bottom_y_start; y < resolution_y; y++) {
-            for (i = 0; i < PIPE_WIDTH && (x + i) < resolution_x; i++) {
-                plot_pixel(x + i, y, color);
-            }
-        }
-    }
+void draw_pipe_direct(struct video_client *client, int x, int top_height, int gap_size, short int color) {
+    draw_pipe(client->raster, &client->target, x, PIPE_WIDTH >> client->lowres_shift, top_height, gap_size, color);
 }
 
 // Draw ASCII text at specified coordinates (x, y)
@@ -128,12 +296,14 @@ void draw_text(int x, int y, const char *text) {
 void swap_buffers(void) {
     volatile int *status_reg = (volatile int *)(LW_virtual + STATUS_REG - LW_BRIDGE_BASE);
     volatile void *temp;
+    u64 start = ktime_get_ns();
     
     // Trigger the hardware buffer swap
     *buffer_register = BUFFER_SWAP_TRIGGER;
     
     // Wait for the swap to complete (S bit becomes 0)
     while ((*status_reg & STATUS_S_BIT) != 0);
+    atomic64_add(ktime_get_ns() - start, &video_stats.swap_spin_ns);
     
     // Update our software pointers to match hardware swap
     temp = pixel_buffer;
@@ -141,6 +311,85 @@ void swap_buffers(void) {
     current_back_buffer = temp;
 }
 
+// Point drawing at the overlay frame being drawn, the lowres buffer if there is
+// one, otherwise the back buffer
+void select_target(struct video_client *client) {
+    struct surface *target = &client->target;
+
+    if (!client->owner) {
+        target->pixels = client->frames[!client->shown].pixels;
+        target->width = resolution_x;
+        target->height = resolution_y;
+        target->stride = resolution_x * sizeof(unsigned short);
+    } else if (client->lowres_buffer) {
+        target->pixels = client->lowres_buffer;
+        target->width = resolution_x >> 1;
+        target->height = resolution_y >> 1;
+        target->stride = target->width * sizeof(unsigned short);
+    } else {
+        target->pixels = current_back_buffer;
+        target->width = resolution_x;
+        target->height = resolution_y;
+        target->stride = ROW_BYTES;
+    }
+    target->stats = &raster_stats;
+}
+
+// Switch lowres mode, only the screen owner has one. Sprites, layers and the
+// background are sized for the old target, so they are dropped and have to be
+// uploaded again.
+int set_lowres(struct video_client *client, int enable) {
+    int i;
+
+    if (!client->owner)
+        return -EINVAL;
+    if (enable && !client->lowres_buffer) {
+        client->lowres_buffer = kzalloc((resolution_x >> 1) * (resolution_y >> 1) * sizeof(unsigned short),
+                                        GFP_KERNEL);
+        if (!client->lowres_buffer)
+            return -ENOMEM;
+    } else if (!enable && client->lowres_buffer) {
+        kfree(client->lowres_buffer);
+        client->lowres_buffer = NULL;
+    } else {
+        return SUCCESS;
+    }
+
+    client->lowres_shift = enable ? 1 : 0;
+    for (i = 0; i < MAX_SPRITES; i++)
+        free_sprite(client, i);
+    for (i = 0; i < MAX_LAYERS; i++)
+        free_layer(client, i);
+    vfree(client->background);
+    client->background = NULL;
+    select_target(client);
+    select_raster(client);
+    return SUCCESS;
+}
+
+// Pixel-double the lowres buffer into the back buffer. Each source pixel is
+// widened to a pair in one 32-bit word and stored to both destination rows.
+void upscale(struct video_client *client) {
+    const struct surface *target = &client->target;
+    int x, y;
+
+    if (!client->lowres_buffer)
+        return;
+
+    for (y = 0; y < target->height; y++) {
+        const unsigned short *src = client->lowres_buffer + y * target->width;
+        volatile unsigned int *top = (volatile unsigned int *)(current_back_buffer + (2 * y * ROW_BYTES));
+        volatile unsigned int *bottom = (volatile unsigned int *)((volatile char *)top + ROW_BYTES);
+
+        for (x = 0; x < target->width; x++) {
+            unsigned int pair = src[x] | ((unsigned int)src[x] << 16);
+            top[x] = pair;
+            bottom[x] = pair;
+        }
+    }
+    atomic64_add(resolution_x * resolution_y, &raster_stats.pixels_filled);
+}
+
 // Get screen resolution
 void get_screen_specs(volatile int *pixel_ctrl_ptr) {
     int resolution_reg = *(pixel_ctrl_ptr + 2);
@@ -157,100 +406,756 @@ void get_screen_specs(volatile int *pixel_ctrl_ptr) {
 }
 
 // Updated clear_screen function to clear back buffer
-void clear_screen(void) {
-    if (!current_back_buffer) {
-        printk(KERN_ERR "Error: back buffer is NULL\n");
+void clear_screen(struct video_client *client) {
+    if (!client->target.pixels) {
+        printk_ratelimited(KERN_ERR "Error: back buffer is NULL\n");
         return;
     }
-    memset_io((void *)current_back_buffer, 0, BUFFER_SIZE);
+    client->raster->clear(&client->target);
 }
 
-// Updated plot_pixel function to draw to back buffer
-void plot_pixel(int x, int y, short int color) {
-    volatile short int *pixel_addr;
+// Capture the back buffer as the background image restored at the start of
+// each frame
+int save_background(struct video_client *client) {
+    const struct surface *target = &client->target;
+    int y;
+
+    if (!client->background) {
+        client->background = vmalloc(target->width * target->height * sizeof(unsigned short));
+        if (!client->background)
+            return -ENOMEM;
+    }
+    for (y = 0; y < target->height; y++) {
+        memcpy_fromio(client->background + y * target->width,
+                      (void *)(target->pixels + (y * target->stride)), target->width * 2);
+    }
+    return SUCCESS;
+}
 
-    if (x < 0 || x >= resolution_x || y < 0 || y >= resolution_y) {
-        printk(KERN_ERR "Error: pixel coordinates out of bounds (%d, %d)\n", x, y);
+// Copy a rectangle of a target->width * target->height background into the
+// target, one row copy per line. Without a background this clears the rectangle.
+static void copy_background(const struct surface *target, const unsigned short *background,
+                            int x1, int y1, int x2, int y2) {
+    int y;
+
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= target->width) x2 = target->width - 1;
+    if (y2 >= target->height) y2 = target->height - 1;
+    if (x2 < x1 || y2 < y1)
         return;
+
+    for (y = y1; y <= y2; y++) {
+        void *row = (void *)(target->pixels + (y * target->stride) + (x1 * 2));
+        if (background)
+            memcpy_toio(row, background + y * target->width + x1, (x2 - x1 + 1) * 2);
+        else
+            memset_io(row, 0, (x2 - x1 + 1) * 2);
     }
+    atomic64_add((x2 - x1 + 1) * (y2 - y1 + 1), &target->stats->pixels_filled);
+}
 
-    pixel_addr = (volatile short int *)(current_back_buffer + (y * 0x400) + (x * 2));
-    *pixel_addr = color;
+// Copy a rectangle of the client's saved background into its target
+void restore_background(struct video_client *client, int x1, int y1, int x2, int y2) {
+    copy_background(&client->target, client->background, x1, y1, x2, y2);
 }
 
-// Draw a line between (x0, y0) and (x1, y1) using Bresenham's algorithm
-void draw_line(int x0, int y0, int x1, int y1, short int color) {
-    int is_steep, temp, deltax, deltay, error, y, y_step, x;
+static const struct raster_ops *pick_raster(const struct surface *surface) {
+    return generic_raster ? &generic_ops : specialized_raster(surface);
+}
 
-    is_steep = (abs(y1 - y0) > abs(x1 - x0));
-    
-    if (is_steep) {
-        temp = x0; x0 = y0; y0 = temp;
-        temp = x1; x1 = y1; y1 = temp;
+// Pick a client's kernels once per geometry, at open and when lowres mode changes
+void select_raster(struct video_client *client) {
+    client->raster = pick_raster(&client->target);
+    pr_debug("Raster kernels: %s\n", client->raster->name);
+}
+
+// Draw a filled box (rectangle)
+void draw_box(struct video_client *client, int x1, int y1, int x2, int y2, short int color) {
+    client->raster->fill(&client->target, x1, y1, x2, y2, color);
+}
+
+// Mix a box of the target toward color, alpha / ALPHA_ONE of the way
+void blend_box(struct video_client *client, int x1, int y1, int x2, int y2, unsigned short color, int alpha) {
+    client->raster->blend(&client->target, x1, y1, x2, y2, color, alpha);
+}
+
+void free_sprite(struct video_client *client, int id) {
+    struct sprite *sprite = &client->sprites[id];
+
+    kfree(sprite->pixels);
+    kfree(sprite->spans);
+    kfree(sprite->tinted);
+    sprite->pixels = NULL;
+    sprite->spans = NULL;
+    sprite->tinted = NULL;
+    sprite->span_count = 0;
+}
+
+// Precompute the opaque runs of a sprite and store it under id, replacing any
+// sprite already there. Takes ownership of pixels, pixels equal to key are
+// transparent.
+int store_sprite(struct video_client *client, int id, int width, int height, unsigned short key,
+                 unsigned short *pixels) {
+    struct sprite *sprite = &client->sprites[id];
+    struct sprite_span *spans;
+    int count;
+
+    // Count runs first so the span table is allocated exactly once
+    count = find_spans(pixels, width, height, key, NULL);
+    spans = kmalloc(count * sizeof(*spans), GFP_KERNEL);
+    if (!spans) {
+        kfree(pixels);
+        return -ENOMEM;
+    }
+    find_spans(pixels, width, height, key, spans);
+
+    free_sprite(client, id);
+    sprite->width = width;
+    sprite->height = height;
+    sprite->pixels = pixels;
+    sprite->spans = spans;
+    sprite->span_count = count;
+    return SUCCESS;
+}
+
+// Copy a sprite from user space into the client's sprite store
+int load_sprite(struct video_client *client, int id, int width, int height, unsigned short key,
+                const char *data, size_t size) {
+    unsigned short *pixels;
+
+    if (id < 0 || id >= MAX_SPRITES || width <= 0 || height <= 0 ||
+        width > SPRITE_MAX_WIDTH || height > SPRITE_MAX_HEIGHT ||
+        size != (size_t)width * height * sizeof(unsigned short)) {
+        return -EINVAL;
     }
 
-    if (x0 > x1) {
-        temp = x0; x0 = x1; x1 = temp;
-        temp = y0; y0 = y1; y1 = temp;
+    pixels = kmalloc(size, GFP_KERNEL);
+    if (!pixels)
+        return -ENOMEM;
+    if (copy_from_user(pixels, data, size)) {
+        kfree(pixels);
+        return -EFAULT;
     }
 
-    deltax = x1 - x0;
-    deltay = abs(y1 - y0);
-    error = -(deltax / 2);
-    y = y0;
-    y_step = (y0 < y1) ? 1 : -1;
+    // In lowres mode keep every other pixel of every other row, in place
+    if (client->lowres_shift) {
+        int x, y;
 
-    for (x = x0; x <= x1; x++) {
-        if (is_steep) {
-            plot_pixel(y, x, color);
-        } else {
-            plot_pixel(x, y, color);
+        for (y = 0; y < height >> 1; y++) {
+            for (x = 0; x < width >> 1; x++)
+                pixels[y * (width >> 1) + x] = pixels[2 * y * width + 2 * x];
         }
-        error += deltay;
-        if (error >= 0) {
-            y += y_step;
-            error -= deltax;
+        width >>= 1;
+        height >>= 1;
+        if (!width || !height) {
+            kfree(pixels);
+            return -EINVAL;
         }
     }
+    return store_sprite(client, id, width, height, key, pixels);
 }
 
-// Draw a filled box (rectangle)
-void draw_box(int x1, int y1, int x2, int y2, short int color) {
-    int x, y;
-    for (y = y1; y <= y2; y++) {
-        for (x = x1; x <= x2; x++) {
-            plot_pixel(x, y, color);
+// Pre-rasterize a string into the sprite store so repeated labels are drawn with
+// a single "blit" of row copies instead of glyph by glyph
+int create_label(struct video_client *client, int id, int scale, unsigned short color, const char *text) {
+    unsigned short key = ~color;  // Any value other than color works as the key
+    unsigned short *pixels;
+    int len = strlen(text);
+    int width, height;
+    int i;
+
+    // Lowres glyphs keep their screen size down to scale 1, odd scales round
+    // down. main.c's label_scale() centers labels on the same rule.
+    if (scale > 1)
+        scale >>= client->lowres_shift;
+    width = len * FONT_ADVANCE * scale - scale;  // No spacing after the last glyph
+    height = FONT_HEIGHT * scale;
+
+    if (id < 0 || id >= MAX_SPRITES || len == 0 || scale < 1 || scale > LABEL_MAX_SCALE ||
+        width > SPRITE_MAX_WIDTH || height > SPRITE_MAX_HEIGHT) {
+        return -EINVAL;
+    }
+
+    pixels = kmalloc(width * height * sizeof(unsigned short), GFP_KERNEL);
+    if (!pixels)
+        return -ENOMEM;
+    for (i = 0; i < width * height; i++)
+        pixels[i] = key;
+    rasterize_text(pixels, width, scale, color, text);
+    return store_sprite(client, id, width, height, key, pixels);
+}
+
+// Draw a string glyph by glyph straight into the back buffer, for text that
+// changes every frame and is not worth caching as a label
+void draw_glyph_text(struct video_client *client, int x, int y, int scale, unsigned short color,
+                     const char *text) {
+    if (scale < 1 || scale > LABEL_MAX_SCALE)
+        return;
+    draw_glyphs(&client->target, x, y, scale, color, text);
+}
+
+// Draw a stored sprite with its top-left corner at (x, y)
+void blit_sprite(struct video_client *client, int id, int x, int y) {
+    const struct sprite *sprite;
+
+    if (id < 0 || id >= MAX_SPRITES || !client->sprites[id].pixels)
+        return;
+    sprite = &client->sprites[id];
+    client->raster->blit(&client->target, sprite->pixels, sprite->width, sprite->spans,
+                         sprite->span_count, x, y);
+}
+
+// Draw a stored sprite alpha / ALPHA_ONE opaque over the target
+void blend_sprite(struct video_client *client, int id, int x, int y, int alpha) {
+    const struct sprite *sprite;
+
+    if (id < 0 || id >= MAX_SPRITES || !client->sprites[id].pixels)
+        return;
+    sprite = &client->sprites[id];
+    client->raster->blend_blit(&client->target, sprite->pixels, sprite->width, sprite->spans,
+                               sprite->span_count, x, y, alpha);
+}
+
+// Pixels of a sprite averaged with tint, cached until a different tint is asked
+// for. Only the opaque pixels the spans copy are computed.
+static const unsigned short *tinted_pixels(struct sprite *sprite, unsigned short tint) {
+    int i, x;
+
+    if (sprite->tinted && sprite->tint == tint)
+        return sprite->tinted;
+    if (!sprite->tinted) {
+        sprite->tinted = kmalloc(sprite->width * sprite->height * sizeof(unsigned short), GFP_KERNEL);
+        if (!sprite->tinted)
+            return sprite->pixels;
+    }
+    for (i = 0; i < sprite->span_count; i++) {
+        const struct sprite_span *span = &sprite->spans[i];
+        int start = span->row * sprite->width + span->x;
+
+        // Halve each channel of both colors before adding, so nothing carries
+        // into the next channel
+        for (x = start; x < start + span->length; x++)
+            sprite->tinted[x] = ((sprite->pixels[x] & 0xF7DE) >> 1) + ((tint & 0xF7DE) >> 1);
+    }
+    sprite->tint = tint;
+    return sprite->tinted;
+}
+
+// Draw count copies of stored sprites from one user space array of struct
+// instance, in order, so later instances end up on top. The batch is copied
+// in once and each copy is a single blit, there is no per-copy parsing.
+int draw_instances(struct video_client *client, const char *data, size_t size, int count) {
+    int shift = client->lowres_shift;
+    int i;
+
+    if (count < 1 || count > MAX_INSTANCES || size != count * sizeof(struct instance))
+        return -EINVAL;
+    if (copy_from_user(client->instances, data, size))
+        return -EFAULT;
+
+    for (i = 0; i < count; i++) {
+        const struct instance *instance = &client->instances[i];
+        struct sprite *sprite;
+        const unsigned short *pixels;
+
+        if (instance->id >= MAX_SPRITES || !client->sprites[instance->id].pixels)
+            continue;
+        sprite = &client->sprites[instance->id];
+        pixels = instance->tint ? tinted_pixels(sprite, instance->tint) : sprite->pixels;
+        client->raster->blit(&client->target, pixels, sprite->width, sprite->spans,
+                             sprite->span_count, instance->x >> shift, instance->y >> shift);
+    }
+    return SUCCESS;
+}
+
+void free_layer(struct video_client *client, int id) {
+    struct layer *layer = &client->layers[id];
+
+    vfree(layer->pixels);
+    kfree(layer->spans);
+    kfree(layer->column_spans);
+    layer->pixels = NULL;
+    layer->spans = NULL;
+    layer->column_spans = NULL;
+    layer->columns = 0;
+}
+
+// Build layer id from a row of stored sprites, all the same size, so later
+// changes to the sprite store do not affect it
+int create_layer(struct video_client *client, int id, int y, int rate, const int *tiles, int count) {
+    const struct sprite *sprites = client->sprites;
+    struct layer layer;
+    int i, span_count = 0;
+    size_t tile_size;
+
+    if (id < 0 || id >= MAX_LAYERS || count < 1 || count > LAYER_MAX_TILES)
+        return -EINVAL;
+    for (i = 0; i < count; i++) {
+        if (tiles[i] < 0 || tiles[i] >= MAX_SPRITES || !sprites[tiles[i]].pixels ||
+            sprites[tiles[i]].width != sprites[tiles[0]].width ||
+            sprites[tiles[i]].height != sprites[tiles[0]].height) {
+            return -EINVAL;
+        }
+        span_count += sprites[tiles[i]].span_count;
+    }
+
+    layer.y = y;
+    layer.rate = rate;
+    layer.tile_width = sprites[tiles[0]].width;
+    layer.height = sprites[tiles[0]].height;
+    layer.columns = count;
+    tile_size = layer.tile_width * layer.height * sizeof(unsigned short);
+    layer.pixels = vmalloc(count * tile_size);
+    layer.spans = kmalloc(span_count * sizeof(*layer.spans), GFP_KERNEL);
+    layer.column_spans = kmalloc((count + 1) * sizeof(int), GFP_KERNEL);
+    if (!layer.pixels || !layer.spans || !layer.column_spans) {
+        vfree(layer.pixels);
+        kfree(layer.spans);
+        kfree(layer.column_spans);
+        return -ENOMEM;
+    }
+
+    span_count = 0;
+    for (i = 0; i < count; i++) {
+        const struct sprite *tile = &sprites[tiles[i]];
+
+        memcpy(layer.pixels + i * layer.tile_width * layer.height, tile->pixels, tile_size);
+        memcpy(layer.spans + span_count, tile->spans, tile->span_count * sizeof(*tile->spans));
+        layer.column_spans[i] = span_count;
+        span_count += tile->span_count;
+    }
+    layer.column_spans[count] = span_count;
+
+    free_layer(client, id);
+    client->layers[id] = layer;
+    return SUCCESS;
+}
+
+// Compose the first count layers at a world scroll position in 1/256 pixels,
+// copying each tile column that overlaps the screen
+void draw_layers(struct video_client *client, u64 scroll, int count) {
+    int id;
+
+    if (count > MAX_LAYERS)
+        count = MAX_LAYERS;
+    for (id = 0; id < count; id++) {
+        const struct layer *layer = &client->layers[id];
+        u32 offset;
+        int column, x;
+
+        if (!layer->pixels)
+            continue;
+        div_u64_rem((scroll * layer->rate) >> 16, layer->columns * layer->tile_width, &offset);
+        column = offset / layer->tile_width;
+        x = column * layer->tile_width - offset;
+        for (; x < client->target.width; x += layer->tile_width) {
+            int first = layer->column_spans[column];
+
+            client->raster->blit(&client->target,
+                                 layer->pixels + column * layer->tile_width * layer->height,
+                                 layer->tile_width, layer->spans + first,
+                                 layer->column_spans[column + 1] - first, x, layer->y);
+            if (++column == layer->columns)
+                column = 0;
         }
     }
 }
 
-void clear_both_buffers(void) {
+// Give a client an overlay of its own, drawn above every existing one
+int open_overlay(struct video_client *client) {
+    size_t pixels = (size_t)resolution_x * resolution_y;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        struct sprite *frame = &client->frames[i];
+
+        frame->width = resolution_x;
+        frame->height = resolution_y;
+        frame->pixels = vzalloc(pixels * sizeof(unsigned short));
+        // A row has at most one run for every two pixels
+        frame->spans = vmalloc(resolution_y * ((resolution_x + 1) / 2) * sizeof(*frame->spans));
+        if (!frame->pixels || !frame->spans) {
+            close_overlay(client);
+            return -ENOMEM;
+        }
+    }
+
+    mutex_lock(&compose_lock);
+    client->z = OVERLAY_MIN_Z;
+    if (!list_empty(&overlays))
+        client->z = list_last_entry(&overlays, struct video_client, node)->z;
+    list_add_tail(&client->node, &overlays);
+    mutex_unlock(&compose_lock);
+    return SUCCESS;
+}
+
+void close_overlay(struct video_client *client) {
+    int i;
+
+    mutex_lock(&compose_lock);
+    if (!list_empty(&client->node))
+        list_del_init(&client->node);
+    mutex_unlock(&compose_lock);
+
+    for (i = 0; i < 2; i++) {
+        vfree(client->frames[i].pixels);
+        vfree(client->frames[i].spans);
+        client->frames[i].pixels = NULL;
+        client->frames[i].spans = NULL;
+        client->frames[i].span_count = 0;
+    }
+}
+
+// Move an overlay to z, above the overlays already there
+void set_overlay_z(struct video_client *client, int z) {
+    struct video_client *other;
+
+    mutex_lock(&compose_lock);
+    list_del(&client->node);
+    client->z = z;
+    list_for_each_entry(other, &overlays, node) {
+        if (other->z > z)
+            break;
+    }
+    list_add_tail(&client->node, &other->node);
+    mutex_unlock(&compose_lock);
+}
+
+// Make the frame an overlay client has drawn the one the compose reads. Its
+// runs are found first, so the lock only covers flipping the frames.
+void publish_overlay(struct video_client *client) {
+    struct sprite *frame = &client->frames[!client->shown];
+
+    frame->span_count = find_spans(frame->pixels, frame->width, frame->height, OVERLAY_KEY, frame->spans);
+    mutex_lock(&compose_lock);
+    client->shown = !client->shown;
+    mutex_unlock(&compose_lock);
+    select_target(client);
+}
+
+// Copy the opaque runs of every published overlay into the back buffer, lowest
+// z first. Runs once per present by the screen owner.
+void compose_overlays(void) {
+    struct surface screen = {
+        .pixels = current_back_buffer,
+        .stride = ROW_BYTES,
+        .width = resolution_x,
+        .height = resolution_y,
+        .stats = &raster_stats,
+    };
+    const struct raster_ops *ops = pick_raster(&screen);
+    struct video_client *client;
+
+    mutex_lock(&compose_lock);
+    list_for_each_entry(client, &overlays, node) {
+        const struct sprite *frame = &client->frames[client->shown];
+
+        ops->blit(&screen, frame->pixels, frame->width, frame->spans, frame->span_count, 0, 0);
+    }
+    mutex_unlock(&compose_lock);
+}
+
+// Clear both pixel buffers, or for an overlay client both of its frames
+void clear_both_buffers(struct video_client *client) {
+    if (!client->owner) {
+        client->raster->clear(&client->target);
+        publish_overlay(client);
+        client->raster->clear(&client->target);
+        return;
+    }
     if (!pixel_buffer || !current_back_buffer) {
-        printk(KERN_ERR "Error: buffer pointers are NULL\n");
+        printk_ratelimited(KERN_ERR "Error: buffer pointers are NULL\n");
         return;
     }
     // Clear both buffers using memset_io
     memset_io((void *)pixel_buffer, 0, BUFFER_SIZE);
     memset_io((void *)current_back_buffer, 0, BUFFER_SIZE);
+    if (client->lowres_buffer)
+        memset(client->lowres_buffer, 0, client->target.height * client->target.stride);
+    atomic64_add(2 * resolution_x * resolution_y, &raster_stats.pixels_filled);
 }
 
 // Synchronize with the VGA controller
 void sync_vga(void) {
     volatile int *status_reg = (volatile int *)(LW_virtual + STATUS_REG - LW_BRIDGE_BASE);
+    u64 start = ktime_get_ns();
     
     // Write 1 to Buffer register to initiate synchronization
     *buffer_register = BUFFER_SWAP_TRIGGER;
     
     // Wait for S bit to become 0, indicating swap completion
     while ((*status_reg & STATUS_S_BIT) != 0);
+    atomic64_add(ktime_get_ns() - start, &video_stats.sync_spin_ns);
+}
+
+// Record the time since start into a stage and return the current time. start
+// is 0 when profiling was off at the start of the stage, profile_mark(-1, 0)
+// just returns a timestamp.
+static u64 profile_mark(int stage, u64 start) {
+    struct profile_stage *entry;
+    u64 now, ns, us;
+    int bucket = 0;
+
+    if (!profile)
+        return 0;
+    now = ktime_get_ns();
+    if (stage < 0 || start == 0)
+        return now;
+
+    entry = &profile_stages[stage];
+    ns = now - start;
+    for (us = ns / 1000; us > 0 && bucket < PROFILE_BUCKETS - 1; us >>= 1)
+        bucket++;
+    spin_lock(&profile_lock);
+    entry->buckets[bucket]++;
+    entry->count++;
+    entry->total_ns += ns;
+    if (ns > entry->max_ns)
+        entry->max_ns = ns;
+    spin_unlock(&profile_lock);
+    return now;
+}
+
+static int profile_show(struct seq_file *m, void *v) {
+    int i, b;
+
+    seq_printf(m, "%-8s %10s %10s %10s  histogram (from us: count)\n", "stage", "count", "avg ns", "max ns");
+    for (i = 0; i < PROF_STAGES; i++) {
+        struct profile_stage entry;
+
+        spin_lock(&profile_lock);
+        entry = profile_stages[i];  // Consistent copy, printing may sleep
+        spin_unlock(&profile_lock);
+        seq_printf(m, "%-8s %10llu %10llu %10llu ", entry.name, entry.count,
+                   entry.count ? div64_u64(entry.total_ns, entry.count) : 0, entry.max_ns);
+        for (b = 0; b < PROFILE_BUCKETS; b++) {
+            if (entry.buckets[b] == 0)
+                continue;
+            if (b == 0)
+                seq_printf(m, " <1:%u", entry.buckets[b]);
+            else
+                seq_printf(m, " %u:%u", 1u << (b - 1), entry.buckets[b]);
+        }
+        seq_puts(m, "\n");
+    }
+    return 0;
 }
 
-// Device functions
+static int profile_open(struct inode *inode, struct file *file) {
+    return single_open(file, profile_show, NULL);
+}
+
+// Any write resets the histograms
+static ssize_t profile_reset(struct file *file, const char *buffer, size_t length, loff_t *offset) {
+    int i;
+
+    spin_lock(&profile_lock);
+    for (i = 0; i < PROF_STAGES; i++) {
+        const char *name = profile_stages[i].name;
+        memset(&profile_stages[i], 0, sizeof(profile_stages[i]));
+        profile_stages[i].name = name;
+    }
+    spin_unlock(&profile_lock);
+    return length;
+}
+
+static const struct file_operations profile_fops = {
+    .open = profile_open,
+    .read = seq_read,
+    .write = profile_reset,
+    .llseek = seq_lseek,
+    .release = single_release
+};
+
+static int stats_show(struct seq_file *m, void *v) {
+    int i;
+
+    for (i = 0; i < CMD_TYPES; i++)
+        seq_printf(m, "%-16s %lld\n", command_names[i], atomic64_read(&video_stats.commands[i]));
+    seq_printf(m, "%-16s %lld\n", "bytes_written", atomic64_read(&video_stats.bytes_written));
+    seq_printf(m, "%-16s %lld\n", "pixels_filled", atomic64_read(&raster_stats.pixels_filled));
+    seq_printf(m, "%-16s %lld\n", "parse_failures", atomic64_read(&video_stats.parse_failures));
+    seq_printf(m, "%-16s %lld\n", "out_of_bounds", atomic64_read(&raster_stats.out_of_bounds));
+    seq_printf(m, "%-16s %lld\n", "sync_spin_ns", atomic64_read(&video_stats.sync_spin_ns));
+    seq_printf(m, "%-16s %lld\n", "swap_spin_ns", atomic64_read(&video_stats.swap_spin_ns));
+    return 0;
+}
+
+static int stats_open(struct inode *inode, struct file *file) {
+    return single_open(file, stats_show, NULL);
+}
+
+// Any write resets the counters
+static ssize_t stats_reset(struct file *file, const char *buffer, size_t length, loff_t *offset) {
+    int i;
+
+    for (i = 0; i < CMD_TYPES; i++)
+        atomic64_set(&video_stats.commands[i], 0);
+    atomic64_set(&video_stats.bytes_written, 0);
+    atomic64_set(&video_stats.parse_failures, 0);
+    atomic64_set(&video_stats.sync_spin_ns, 0);
+    atomic64_set(&video_stats.swap_spin_ns, 0);
+    atomic64_set(&raster_stats.pixels_filled, 0);
+    atomic64_set(&raster_stats.out_of_bounds, 0);
+    return length;
+}
+
+static const struct file_operations stats_fops = {
+    .open = stats_open,
+    .read = seq_read,
+    .write = stats_reset,
+    .llseek = seq_lseek,
+    .release = single_release
+};
+
+// Time each kernel of ops against a surface, average ns per call. restore is
+// the full-screen background copy frames start with instead of a clear.
+static void bench_raster(struct seq_file *m, const struct raster_ops *ops, const struct surface *surface,
+                         const unsigned short *background) {
+    static unsigned short pixels[32 * 32];
+    static struct sprite_span spans[32];
+    u64 start, clear_ns, restore_ns, box_ns, column_ns, blit_ns, blend_ns;
+    int i;
+
+    for (i = 0; i < 32; i++) {
+        spans[i].row = i;
+        spans[i].x = 0;
+        spans[i].length = 32;
+    }
+
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_REPEATS; i++)
+        ops->clear(surface);
+    clear_ns = ktime_get_ns() - start;
+
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_REPEATS; i++)
+        copy_background(surface, background, 0, 0, surface->width - 1, surface->height - 1);
+    restore_ns = ktime_get_ns() - start;
+
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_REPEATS; i++)
+        ops->fill(surface, i % 64, i % 64, i % 64 + 31, i % 64 + 31, 0x07E0);
+    box_ns = ktime_get_ns() - start;
+
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_REPEATS; i++)
+        ops->fill(surface, i % 64, 0, i % 64 + PIPE_WIDTH - 1, surface->height - 1, 0x07E0);
+    column_ns = ktime_get_ns() - start;
+
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_REPEATS; i++)
+        ops->blit(surface, pixels, 32, spans, 32, i % 64, i % 64);
+    blit_ns = ktime_get_ns() - start;
+
+    start = ktime_get_ns();
+    for (i = 0; i < BENCH_REPEATS; i++)
+        ops->blend(surface, 0, 0, surface->width - 1, surface->height - 1, 0x0000, ALPHA_ONE / 2);
+    blend_ns = ktime_get_ns() - start;
+
+    seq_printf(m, "%-8s %10llu %10llu %10llu %10llu %10llu %10llu\n", ops->name,
+               div64_u64(clear_ns, BENCH_REPEATS), div64_u64(restore_ns, BENCH_REPEATS),
+               div64_u64(box_ns, BENCH_REPEATS),
+               div64_u64(column_ns, BENCH_REPEATS), div64_u64(blit_ns, BENCH_REPEATS),
+               div64_u64(blend_ns, BENCH_REPEATS));
+}
+
+// Reading runs the benchmark, it draws over the back buffer and counts into
+// its own stats, leaving the driver's untouched. Only the screen owner draws
+// into or swaps the back buffers, so the bench refuses while there is one and
+// holds compose_lock so none can open.
+// The kernels are timed against the real buffer, reads over the FPGA bridge
+// included, rather than against cached memory.
+static int bench_show(struct seq_file *m, void *v) {
+    struct raster_stats scratch = {};
+    struct surface screen;
+    unsigned short *background;
+
+    mutex_lock(&compose_lock);
+    if (screen_owner) {
+        mutex_unlock(&compose_lock);
+        return -EBUSY;
+    }
+    screen.pixels = current_back_buffer;
+    screen.stride = ROW_BYTES;
+    screen.width = resolution_x;
+    screen.height = resolution_y;
+    screen.stats = &scratch;
+    background = vzalloc(screen.width * screen.height * sizeof(unsigned short));
+    if (!background) {
+        mutex_unlock(&compose_lock);
+        return -ENOMEM;
+    }
+
+    seq_printf(m, "%dx%d stride %d, ns per call\n", screen.width, screen.height, screen.stride);
+    seq_printf(m, "%-8s %10s %10s %10s %10s %10s %10s\n", "kernels", "clear", "restore", "box32", "pipe",
+               "blit32", "blend");
+    bench_raster(m, &generic_ops, &screen, background);
+    if (specialized_raster(&screen) != &generic_ops)
+        bench_raster(m, specialized_raster(&screen), &screen, background);
+    vfree(background);
+    mutex_unlock(&compose_lock);
+    return 0;
+}
+
+static int bench_open(struct inode *inode, struct file *file) {
+    return single_open(file, bench_show, NULL);
+}
+
+static const struct file_operations bench_fops = {
+    .open = bench_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release
+};
+
+// Device functions. The first client to open the device owns the screen,
+// later ones get an overlay until the owner closes.
 static int device_open(struct inode *inode, struct file *file) {
+    struct video_client *client = kzalloc(sizeof(*client), GFP_KERNEL);
+    int ret;
+
+    if (!client)
+        return -ENOMEM;
+    INIT_LIST_HEAD(&client->node);
+
+    mutex_lock(&compose_lock);
+    client->owner = !screen_owner;
+    if (client->owner)
+        screen_owner = client;
+    mutex_unlock(&compose_lock);
+
+    if (!client->owner) {
+        ret = open_overlay(client);
+        if (ret < 0) {
+            kfree(client);
+            return ret;
+        }
+    }
+    select_target(client);
+    select_raster(client);
+    file->private_data = client;
     return SUCCESS;
 }
 
 static int device_release(struct inode *inode, struct file *file) {
+    struct video_client *client = file->private_data;
+    int i;
+
+    mutex_lock(&compose_lock);
+    if (screen_owner == client)
+        screen_owner = NULL;
+    mutex_unlock(&compose_lock);
+
+    close_overlay(client);
+    for (i = 0; i < MAX_SPRITES; i++)
+        free_sprite(client, i);
+    for (i = 0; i < MAX_LAYERS; i++)
+        free_layer(client, i);
+    vfree(client->background);
+    kfree(client->lowres_buffer);
+    kfree(client);
     return SUCCESS;
 }
 
@@ -267,6 +1172,13 @@ static ssize_t device_read(struct file *filp, char *buffer, size_t length, loff_
     return bytes_read;
 }
 
+// Remove one trailing newline or carriage return from a command argument
+static void strip_newline(char *text) {
+    size_t len = strlen(text);
+    if (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+        text[len - 1] = '\0';
+}
+
 // Write function for handling commands
 static ssize_t device_write(struct file *filp, const char *buffer, size_t length, loff_t *offset) {
     int x1, y1, x2, y2;
@@ -276,22 +1188,65 @@ static ssize_t device_write(struct file *filp, const char *buffer, size_t length
     char *text_str;
     char position_part[BUF_LEN];
     int pipe_x, pipe_top, pipe_gap;
-    if (sscanf(cmd, "pipe %d,%d,%d %x", &pipe_x, &pipe_top, &pipe_gap, &color) == 4) {
-        draw_pipe_direct(pipe_x, pipe_top, pipe_gap, (short int)color);
-        return length;
+    int id, width, height;
+    int alpha;
+    int text_start = 0;
+    struct video_client *client = filp->private_data;
+    int shift = client->lowres_shift;
+    size_t header_len = (length < BUF_LEN) ? length : BUF_LEN - 1;
+    u64 t = profile_mark(-1, 0);
+
+    atomic64_add(length, &video_stats.bytes_written);
+    if (copy_from_user(cmd, buffer, header_len))
+        return -EFAULT;
+
+    cmd[header_len] = '\0';
+
+    // Handle the "sprite id,w,h key" upload, raw RGB565 pixels follow the newline
+    if (strncmp(cmd, "sprite ", 7) == 0) {
+        char *newline = strchr(cmd, '\n');
+        int ret;
+
+        if (!newline || sscanf(cmd, "sprite %d,%d,%d %x", &id, &width, &height, &color) != 4) {
+            atomic64_inc(&video_stats.parse_failures);
+            return -EINVAL;
+        }
+        atomic64_inc(&video_stats.commands[CMD_SPRITE]);
+        t = profile_mark(PROF_PARSE, t);
+        ret = load_sprite(client, id, width, height, (unsigned short)color,
+                          buffer + (newline - cmd) + 1, length - (newline - cmd) - 1);
+        profile_mark(PROF_UPLOAD, t);
+        return (ret < 0) ? ret : length;
     }
 
-    if (length > BUF_LEN)
-        return -EINVAL;
+    // Handle "instances count", count struct instance records follow the newline
+    if (strncmp(cmd, "instances ", 10) == 0) {
+        char *newline = strchr(cmd, '\n');
+        int count, ret;
 
-    if (copy_from_user(cmd, buffer, length))
-        return -EFAULT;
+        if (!newline || sscanf(cmd, "instances %d", &count) != 1) {
+            atomic64_inc(&video_stats.parse_failures);
+            return -EINVAL;
+        }
+        atomic64_inc(&video_stats.commands[CMD_INSTANCES]);
+        t = profile_mark(PROF_PARSE, t);
+        ret = draw_instances(client, buffer + (newline - cmd) + 1, length - (newline - cmd) - 1, count);
+        profile_mark(PROF_RASTER, t);
+        return (ret < 0) ? ret : length;
+    }
 
-    cmd[length] = '\0';
+    // Every other command fits in a single line
+    if (length >= BUF_LEN) {
+        atomic64_inc(&video_stats.parse_failures);
+        return -EINVAL;
+    }
 
     // Handle erase command for character buffer
     if (strncmp(cmd, "erase", 5) == 0) {
+        atomic64_inc(&video_stats.commands[CMD_ERASE]);
+        t = profile_mark(PROF_PARSE, t);
         clear_text_buffer();
+        profile_mark(PROF_RASTER, t);
         return length;
     }
 
@@ -312,48 +1267,249 @@ static ssize_t device_write(struct file *filp, const char *buffer, size_t length
             }
 
             if (sscanf(position_part, "%d,%d", &x, &y) == 2) {
+                atomic64_inc(&video_stats.commands[CMD_TEXT]);
+                t = profile_mark(PROF_PARSE, t);
                 draw_text(x, y, text_str);
+                profile_mark(PROF_RASTER, t);
                 return length;
             }
         }
+        atomic64_inc(&video_stats.parse_failures);
         return -EINVAL;  
     }
 
     if (strncmp(cmd, "clear_both", 10) == 0) {
-        clear_both_buffers();
+        atomic64_inc(&video_stats.commands[CMD_CLEAR_BOTH]);
+        t = profile_mark(PROF_PARSE, t);
+        clear_both_buffers(client);
+        profile_mark(PROF_CLEAR, t);
         return length;
     }
     
-    // Handle sync command
+    // Handle sync command, overlay clients never wait on the VGA controller
     if (strncmp(cmd, "sync", 4) == 0) {
-        sync_vga();
+        atomic64_inc(&video_stats.commands[CMD_SYNC]);
+        t = profile_mark(PROF_PARSE, t);
+        if (client->owner)
+            sync_vga();
+        profile_mark(PROF_SYNC, t);
         return length;
     }
 
-    // Handle swap command
+    // Handle swap command. The owner composes the overlays and presents, an
+    // overlay client publishes the frame it has drawn for the next compose.
     if (strncmp(cmd, "swap", 4) == 0) {
+        atomic64_inc(&video_stats.commands[CMD_SWAP]);
+        t = profile_mark(PROF_PARSE, t);
+        if (!client->owner) {
+            publish_overlay(client);
+            profile_mark(PROF_PUBLISH, t);
+            return length;
+        }
+        compose_overlays();
+        t = profile_mark(PROF_COMPOSE, t);
         swap_buffers();
+        select_target(client);
+        profile_mark(PROF_SWAP, t);
+        return length;
+    }
+
+    // Handle "zorder z", stacking an overlay client above lower z values
+    if (sscanf(cmd, "zorder %d", &x) == 1) {
+        if (client->owner || x < OVERLAY_MIN_Z) {
+            atomic64_inc(&video_stats.parse_failures);
+            return -EINVAL;
+        }
+        atomic64_inc(&video_stats.commands[CMD_ZORDER]);
+        t = profile_mark(PROF_PARSE, t);
+        set_overlay_z(client, x);
+        profile_mark(PROF_COMPOSE, t);
+        return length;
+    }
+
+    // Handle "lowres 0|1", drawing at half resolution until "upscale" doubles it
+    if (sscanf(cmd, "lowres %d", &x) == 1) {
+        int ret;
+
+        atomic64_inc(&video_stats.commands[CMD_LOWRES]);
+        t = profile_mark(PROF_PARSE, t);
+        ret = set_lowres(client, x);
+        profile_mark(PROF_UPLOAD, t);
+        return (ret < 0) ? ret : length;
+    }
+
+    // Handle upscale command, a no-op outside lowres mode
+    if (strncmp(cmd, "upscale", 7) == 0) {
+        atomic64_inc(&video_stats.commands[CMD_UPSCALE]);
+        t = profile_mark(PROF_PARSE, t);
+        upscale(client);
+        profile_mark(PROF_UPSCALE, t);
+        return length;
+    }
+
+    // Handle bg_save command, the back buffer becomes the cached background
+    if (strncmp(cmd, "bg_save", 7) == 0) {
+        int ret;
+
+        atomic64_inc(&video_stats.commands[CMD_BG_SAVE]);
+        t = profile_mark(PROF_PARSE, t);
+        ret = save_background(client);
+        profile_mark(PROF_UPLOAD, t);
+        return (ret < 0) ? ret : length;
+    }
+
+    // Handle "restore" for the whole screen or "restore x1,y1 x2,y2" for a
+    // damaged region
+    if (strncmp(cmd, "restore", 7) == 0) {
+        atomic64_inc(&video_stats.commands[CMD_RESTORE]);
+        if (sscanf(cmd, "restore %d,%d %d,%d", &x1, &y1, &x2, &y2) != 4) {
+            x1 = 0;
+            y1 = 0;
+            x2 = resolution_x - 1;
+            y2 = resolution_y - 1;
+        }
+        t = profile_mark(PROF_PARSE, t);
+        restore_background(client, x1 >> shift, y1 >> shift, x2 >> shift, y2 >> shift);
+        profile_mark(PROF_CLEAR, t);
+        return length;
+    }
+
+    // Handle "layer id,y,rate tile tile ...", rate is 8.8 fixed point relative
+    // to the world
+    if (sscanf(cmd, "layer %d,%d,%d%n", &id, &y, &width, &text_start) == 3 && text_start > 0) {
+        int tiles[LAYER_MAX_TILES];
+        int count = 0, used, ret;
+
+        atomic64_inc(&video_stats.commands[CMD_LAYER]);
+        text_str = cmd + text_start;
+        while (count < LAYER_MAX_TILES && sscanf(text_str, "%d%n", &tiles[count], &used) == 1) {
+            text_str += used;
+            count++;
+        }
+        t = profile_mark(PROF_PARSE, t);
+        ret = create_layer(client, id, y >> shift, width, tiles, count);
+        profile_mark(PROF_UPLOAD, t);
+        return (ret < 0) ? ret : length;
+    }
+
+    // Handle "parallax scroll [count]", scroll in 1/256 pixels, count limits
+    // the layers drawn
+    if (strncmp(cmd, "parallax", 8) == 0) {
+        unsigned long long scroll;
+        int count = MAX_LAYERS;
+
+        if (sscanf(cmd, "parallax %llu %d", &scroll, &count) < 1) {
+            atomic64_inc(&video_stats.parse_failures);
+            return -EINVAL;
+        }
+        atomic64_inc(&video_stats.commands[CMD_PARALLAX]);
+        t = profile_mark(PROF_PARSE, t);
+        draw_layers(client, scroll >> shift, count);
+        profile_mark(PROF_RASTER, t);
         return length;
     }
 
     // Handle clear command (now clears back buffer)
     if (strncmp(cmd, "clear", 5) == 0) {
-        clear_screen();
+        atomic64_inc(&video_stats.commands[CMD_CLEAR]);
+        t = profile_mark(PROF_PARSE, t);
+        clear_screen(client);
+        profile_mark(PROF_CLEAR, t);
+        return length;
+    }
+
+    // Handle "label id,scale color text", cached text drawn later with blit
+    if (sscanf(cmd, "label %d,%d %x %n", &id, &width, &color, &text_start) == 3 && text_start > 0) {
+        int ret;
+
+        text_str = cmd + text_start;
+        strip_newline(text_str);
+        atomic64_inc(&video_stats.commands[CMD_LABEL]);
+        t = profile_mark(PROF_PARSE, t);
+        ret = create_label(client, id, width, (unsigned short)color, text_str);
+        profile_mark(PROF_UPLOAD, t);
+        return (ret < 0) ? ret : length;
+    }
+
+    // Handle "ptext x,y,scale color text", uncached text in the pixel buffer
+    if (sscanf(cmd, "ptext %d,%d,%d %x %n", &x, &y, &width, &color, &text_start) == 4 && text_start > 0) {
+        text_str = cmd + text_start;
+        strip_newline(text_str);
+        atomic64_inc(&video_stats.commands[CMD_PTEXT]);
+        t = profile_mark(PROF_PARSE, t);
+        if (width > 1)
+            width >>= shift;
+        draw_glyph_text(client, x >> shift, y >> shift, width, (unsigned short)color, text_str);
+        profile_mark(PROF_RASTER, t);
+        return length;
+    }
+
+    // Handle "blend_blit id,x,y alpha", a stored sprite drawn translucent
+    if (sscanf(cmd, "blend_blit %d,%d,%d %d", &id, &x, &y, &alpha) == 4) {
+        if (alpha < 0 || alpha > ALPHA_ONE) {
+            atomic64_inc(&video_stats.parse_failures);
+            return -EINVAL;
+        }
+        atomic64_inc(&video_stats.commands[CMD_BLEND_BLIT]);
+        t = profile_mark(PROF_PARSE, t);
+        blend_sprite(client, id, x >> shift, y >> shift, alpha);
+        profile_mark(PROF_RASTER, t);
+        return length;
+    }
+
+    // Handle blit command for stored sprites
+    if (sscanf(cmd, "blit %d,%d,%d", &id, &x, &y) == 3) {
+        atomic64_inc(&video_stats.commands[CMD_BLIT]);
+        t = profile_mark(PROF_PARSE, t);
+        blit_sprite(client, id, x >> shift, y >> shift);
+        profile_mark(PROF_RASTER, t);
+        return length;
+    }
+
+    if (sscanf(cmd, "pipe %d,%d,%d %x", &pipe_x, &pipe_top, &pipe_gap, &color) == 4) {
+        atomic64_inc(&video_stats.commands[CMD_PIPE]);
+        t = profile_mark(PROF_PARSE, t);
+        draw_pipe_direct(client, pipe_x >> shift, pipe_top >> shift, pipe_gap >> shift, (short int)color);
+        profile_mark(PROF_RASTER, t);
         return length;
     }
 
     // Handle line command
     if (sscanf(cmd, "line %d,%d %d,%d %x", &x1, &y1, &x2, &y2, &color) == 5) {
-        draw_line(x1, y1, x2, y2, (short int)color);
+        atomic64_inc(&video_stats.commands[CMD_LINE]);
+        x1 = clamp(x1, -COORD_LIMIT, COORD_LIMIT);
+        y1 = clamp(y1, -COORD_LIMIT, COORD_LIMIT);
+        x2 = clamp(x2, -COORD_LIMIT, COORD_LIMIT);
+        y2 = clamp(y2, -COORD_LIMIT, COORD_LIMIT);
+        t = profile_mark(PROF_PARSE, t);
+        draw_line(&client->target, x1 >> shift, y1 >> shift, x2 >> shift, y2 >> shift, (short int)color);
+        profile_mark(PROF_RASTER, t);
+        return length;
+    }
+
+    // Handle "blend x1,y1 x2,y2 color alpha", a translucent box
+    if (sscanf(cmd, "blend %d,%d %d,%d %x %d", &x1, &y1, &x2, &y2, &color, &alpha) == 6) {
+        if (alpha < 0 || alpha > ALPHA_ONE) {
+            atomic64_inc(&video_stats.parse_failures);
+            return -EINVAL;
+        }
+        atomic64_inc(&video_stats.commands[CMD_BLEND]);
+        t = profile_mark(PROF_PARSE, t);
+        blend_box(client, x1 >> shift, y1 >> shift, x2 >> shift, y2 >> shift, (unsigned short)color, alpha);
+        profile_mark(PROF_RASTER, t);
         return length;
     }
 
     // Handle box command
     if (sscanf(cmd, "box %d,%d %d,%d %x", &x1, &y1, &x2, &y2, &color) == 5) {
-        draw_box(x1, y1, x2, y2, (short int)color);
+        atomic64_inc(&video_stats.commands[CMD_BOX]);
+        t = profile_mark(PROF_PARSE, t);
+        draw_box(client, x1 >> shift, y1 >> shift, x2 >> shift, y2 >> shift, (short int)color);
+        profile_mark(PROF_RASTER, t);
         return length;
     }
 
+    atomic64_inc(&video_stats.parse_failures);
     return -EINVAL;
 }
 
@@ -425,11 +1581,22 @@ static int __init start_video(void) {
     }
 
     clear_text_buffer();
+
+    // Diagnostics are optional, the driver works without debugfs
+    debugfs_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    if (!IS_ERR_OR_NULL(debugfs_dir)) {
+        debugfs_create_file("profile", 0644, debugfs_dir, NULL, &profile_fops);
+        debugfs_create_file("stats", 0644, debugfs_dir, NULL, &stats_fops);
+        debugfs_create_file("bench", 0444, debugfs_dir, NULL, &bench_fops);
+    }
+
     return SUCCESS;
 }
 
 // Cleanup function
 static void __exit stop_video(void) {
+    debugfs_remove_recursive(debugfs_dir);
+
     iounmap(LW_virtual);
     iounmap((void *)pixel_buffer);
     iounmap((void *)current_back_buffer);